@@ -0,0 +1,84 @@
+//
+//  bandit.h
+//  CarGame
+//
+
+/*
+ * belief aware choice among the candidate paths, as a flat bandit. The arms
+ * are the candidates and waiting, picked by UCB1. Each pull samples joint
+ * intentions of the other cars from the belief and rolls the candidate out
+ * against their prediction, there is no tree below the arms and no belief
+ * is updated along a rollout. Every worker thread pulls from its own random
+ * stream, and the statistics of the threads are summed at the end. Without
+ * a time budget a seed and a number of threads give the same choice whatever
+ * the load of the machine.
+ */
+#ifndef BANDIT_H
+#define BANDIT_H
+
+#include <chrono>
+#include <thread>
+
+#include "decision_making.h"
+
+namespace BANDIT {
+
+// statistics of one arm
+struct ActionStats {
+  int visits;
+  double value;
+
+  ActionStats() : visits(0), value(0) {}
+
+  double mean() const { return visits == 0 ? -inf : value / visits; }
+};
+
+//************************************************************************
+// class Planner
+//************************************************************************
+
+class Planner {
+public:
+  // reward of a sample in which the candidate collides, and of waiting
+  static constexpr float COLLISION_REWARD = -1000;
+  static constexpr float WAIT_REWARD = 0;
+
+  // iterations per thread, the threads also stop once budget_ms runs out.
+  // A budget of 0 runs all the iterations
+  Planner(int threads = 0, int iterations = 2000, unsigned int seed = 1, double budget_ms = 40);
+
+  // search the candidate paths like DecisionMaker::getPath and choose one
+  // under the belief, false when waiting is better
+  bool getPath(const Simulation& simulation, DecisionMaker& decision, vector<Vec2f>& final_path,
+               vector<int>& car_intentions, const Counter<vector<string>>& belief);
+
+  // index of the chosen candidate, -1 to wait
+  int plan(const Simulation& simulation, const vector<vector<Vec2f>>& candidates,
+           const Counter<vector<string>>& belief);
+
+  // summed statistics of the arms in the last plan, the last one is waiting
+  const vector<ActionStats>& getStats() const { return arms; }
+
+  int getNumThreads() const { return num_threads; }
+
+private:
+  struct Sample {
+    vector<int> intentions;
+    float cumulative;
+  };
+
+  void worker(int id, const Simulation& simulation, const vector<vector<Vec2f>>& candidates,
+              vector<ActionStats>& stats) const;
+
+  int num_threads;
+  int max_iterations;
+  unsigned int seed;
+  double budget_ms;
+  unsigned int round;
+  vector<Sample> samples;
+  vector<ActionStats> arms;
+};
+
+}  // namespace BANDIT
+
+#endif /* BANDIT_H */
@@ -26,6 +26,23 @@ static UMAP<string, pff> direction = {
   {"southwest", {-1, -1}}
 };
 
+/*
+ * plain dynamic state of a vehicle, trivially copyable so that the state of
+ * a whole simulation can be saved and restored as one flat buffer
+ */
+struct ActorState {
+  Vector2f pos;
+  Vector2f velocity;
+  Vector2f dir;
+  float wheel_angle;
+  // host path tracking
+  int node_id;
+  int pre;
+  // other car stop timer
+  unsigned int timer;
+  bool stop_flag;
+};
+
 // abstract class
 class Actor {
 public:
@@ -81,6 +98,13 @@ public:
 
   virtual void setup();
 
+  virtual void saveState(ActorState& state) const;
+
+  virtual void restoreState(const ActorState& state);
+
+  // a new path is followed from its start
+  virtual void resetPath() {}
+
   Vector2f getPos() const { return pos; }
 
   void setPos(const Vector2f& pos) { this->pos = pos; }
@@ -107,6 +131,10 @@ public:
 
   vector<Vector2f> getBounds(Actor& car, float LEN, float WID);
 
+  // footprint after one update with the wheels turned by angle at the given
+  // speed, computed from the current pose without changing the actor
+  vector<Vector2f> predictBounds(float angle, float speed) const;
+
   // http://www.gamedev.net/page/resources/_/technical/game-programming/2d-rotated-rectangle-collision-r2604
   bool collides(const Vector2f& otherPos, const vector<Vector2f>& otherBounds);
 
@@ -161,6 +189,12 @@ public:
 
   bool isHost() { return true; }
 
+  void saveState(ActorState& state) const;
+
+  void restoreState(const ActorState& state);
+
+  void resetPath();
+
   void autonomousAction(const vector<Vector2f>& path, const Simulation& simulation, kdtree::kdtree<point<float>>* tree);
 
   void autonomousAction(const vector<Vector2f>& path, const Simulation& simulation, int intention = 1);
@@ -172,7 +206,8 @@ public:
   UMAP<string, float> getAutonomousActions(const vector<Vector2f>& path,
                                            const Simulation& simulation);
 
-  void makeObservation(const Simulation& simulation);
+  // push the speeds of the other cars to the observations of the simulation
+  void makeObservation(Simulation& simulation);
 
 private:
   int node_id;
@@ -184,9 +219,6 @@ class Car : public Actor {
 public:
   unsigned int timer = 0;
   bool stop_flag = false;
-  std::queue<float> history;
-  bool has_inference;
-  Inference::MarginalInference* inference;
 
 public:
   Car() : Actor() {}
@@ -211,17 +243,19 @@ public:
     setup();
   }
 
-  Car(const Actor& car) : Actor(car.getPos(), car.getDir(), car.getVelocity()) {}
+  Car(const Actor& car) : Actor(car.getPos(), car.getDir(), car.getVelocity()) {
+    setup();
+  }
 
-  ~Car() {
-    if (inference != nullptr) delete inference;
-  };
+  ~Car(){};
 
   virtual void setup();
 
   bool isHost() { return false; }
 
-  std::queue<float>& getHistory() { return history; }
+  void saveState(ActorState& state) const;
+
+  void restoreState(const ActorState& state);
 
   void autonomousAction(const vector<Vector2f>& path, const Simulation& simulation, kdtree::kdtree<point<float>>* tree);
 
@@ -1,6 +1,7 @@
 #ifndef DECISION_MAKING_H
 #define DECISION_MAKING_H
 
+#include "policy.h"
 #include "search.h"
 
 inline static int xToCol(float x) {
@@ -36,18 +37,26 @@ public:
   static vector<std::string> m_host_actions;
   static vector<std::string> m_other_actions;
   static unordered_map<std::string, float> m_action_rewards;
+  // ticks of other car motion predicted for the space-time search
+  static const int m_prediction_horizon = 100;
   // static const unorder_mapd<std::string, float> command;
 
-  DecisionMaker(int dep = 2, int ind = 0) : depth(dep), index(ind) {}
+  DecisionMaker(int dep = 2, int ind = 0) : depth(dep), index(ind), policy(nullptr) {}
 
   vector<string> generateLegalActions(const Simulation&);
 
-  vector<vector<Vec2f>>& generatePaths(const Simulation&, vector<string>&);
+  vector<vector<Vec2f>>& generatePaths(const Simulation&, vector<string>&,
+                                       const SEARCH::Occupancy* occupancy = nullptr);
 
   void applyAction(const Simulation&, int, const std::string&);
 
   float evaluatePath(const Simulation&, const vector<Vec2f>& path, vector<int>& car_intentions);
 
+  // same scores as evaluatePath on each candidate, shared prefixes are
+  // simulated once
+  vector<float> evaluatePaths(const Simulation&, const vector<vector<Vec2f>>& candidates,
+                              vector<int>& car_intentions);
+
   bool getPath(const Simulation& simulation, vector<Vec2f>& final_path, vector<int>& carIntentions);
 
   vector<vector<Vec2f>> getPaths() { return paths; }
@@ -56,10 +65,85 @@ public:
 
   bool isChangeRequired(const Simulation& simulation);
 
+  // with a policy, getPath only searches when the table says to change lane
+  void setPolicy(const MDP::PolicyTable* table) { policy = table; }
+
+  const SEARCH::PlanCache& getPlanCache() const { return plan_cache; }
+
+  // summed statistics of the searches run by the last generatePaths
+  const SEARCH::SearchStats& getSearchStats() const { return search_stats; }
+
+  // evaluate the path on a simulation the caller has already reset, the host
+  // of sim is moved and the occupancy may be extended
+  float rollout(Simulation& sim, const vector<Vec2f>& path, SEARCH::Occupancy& occupancy);
+
 private:
+
+  float finishRollout(Actor* host, const Simulation& sim, const vector<Vec2f>& path,
+                      const SEARCH::Occupancy& occupancy, int tick) const;
+
+  // candidates of one evaluation, scores of pruned candidates stay -inf
+  struct RolloutBatch {
+    const vector<vector<Vec2f>>& candidates;
+    SEARCH::Occupancy& occupancy;
+    bool prune;
+    vector<float> scores;
+    vector<float> bounds;
+    int best;
+
+    RolloutBatch(const vector<vector<Vec2f>>& c, SEARCH::Occupancy& o, bool p)
+        : candidates(c), occupancy(o), prune(p), best(-1) {}
+
+    bool canBeat(int c) const;
+  };
+
+  // host state shared by a group of candidates with the same prefix
+  struct Lane {
+    vector<int> group;
+    ActorState state;
+  };
+
+  // the host states of the lanes as arrays, so that every step runs over
+  // all the lanes at once
+  struct LaneStates {
+    vector<float> pos_x, pos_y;
+    vector<float> vel_x, vel_y;
+    vector<float> dir_x, dir_y;
+    vector<float> wheel_angle;
+    vector<int> node_id, pre;
+    // broad phase mask of the collision check
+    vector<unsigned char> near;
+
+    void gather(const vector<Lane>& lanes);
+
+    void scatter(vector<Lane>& lanes) const;
+  };
+
+  static float scoreEndpoint(const Vec2f& end, const Vec2f& goal);
+
+  void evaluatePaths(Simulation& sim, RolloutBatch& batch);
+
+  // one tick of Host::autonomousAction and Actor::update in every lane
+  void stepLanes(const Actor& host, const vector<vector<Vec2f>>& candidates, vector<Lane>& lanes);
+
+  // reads the lane positions the last stepLanes left
+  void collideLanes(const Simulation& sim, const SEARCH::Occupancy& occupancy, int tick, vector<Lane>& lanes);
+
+  // same checks as Simulation::checkCollision and isCloseToOtherCar, against
+  // the predicted cars at the given tick
+  bool checkCollision(Actor* host, const Simulation& simulation, const SEARCH::Occupancy& occupancy,
+                      int tick) const;
+
+  bool isCloseToOtherCar(Actor* host, const SEARCH::Occupancy& occupancy, int tick) const;
+
   int depth;
   unsigned int index;
   vector<vector<Vec2f>> paths;
+  SEARCH::PlanCache plan_cache;
+  SEARCH::SearchStats search_stats;
+  const MDP::PolicyTable* policy;
+  // reused between ticks
+  LaneStates lane_states;
 };
 
 #endif /* DECISION_MAKING_H */
@@ -76,7 +76,7 @@ public:
                 Display::GREY, nullptr, 1.0);
   }
 
-  static void drawGoal(Block& goal) {
+  static void drawGoal(const Block& goal) {
     rectangle(goal.getCenter(), goal.getHeight(), goal.getWidth(),
               Display::LIGHTBLUE, nullptr, 1.0);
   }
@@ -0,0 +1,69 @@
+//
+//  driver.h
+//  CarGame
+//
+
+/*
+ * the host's side of the control loop. Each tick the host observes the other
+ * cars, asks for a new plan when the followed one no longer holds, and
+ * follows the newest plan. A synchronous driver waits for every plan it asks
+ * for, so a game is replayed the same way without the graphics.
+ */
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "bandit.h"
+#include "replanner.h"
+
+//************************************************************************
+// class Driver
+//************************************************************************
+
+class Driver {
+public:
+  // without a policy table every lane change is decided by the planner
+  Driver(Simulation& simulation, const MDP::PolicyTable* policy = nullptr, bool synchronous = false);
+
+  Driver(const Driver&) = delete;
+  Driver& operator=(const Driver&) = delete;
+
+  // observe, replan and move the host for the tick, before the other cars move
+  void step(Simulation& simulation, int tick);
+
+  const vector<Vector2f>& getPath() const { return final_path; }
+
+  const vector<vector<Vector2f>>& getCandidates() const { return candidate_paths; }
+
+  // the most likely intention of each other car
+  const vector<int>& getIntentions() const { return car_intentions; }
+
+  const Replanner& getReplanner() const { return replanner; }
+
+  const ReplanTrigger& getTrigger() const { return trigger; }
+
+private:
+  Replanner::PlanFunction planFunction(DecisionMaker* maker, BANDIT::Planner* searcher);
+
+  // push the observations of the tick and take the most likely intentions
+  void observe(Simulation& simulation);
+
+  // follow a plan taken from the replanner
+  void take(Simulation& simulation, int tick);
+
+  const MDP::PolicyTable* policy;
+  bool synchronous;
+  DecisionMaker decision;
+  BANDIT::Planner planner;
+  DecisionMaker speculative_decision;
+  BANDIT::Planner speculative_planner;
+  Replanner replanner;
+  ReplanTrigger trigger;
+  Replanner::Plan plan;
+  vector<Vector2f> final_path;
+  vector<vector<Vector2f>> candidate_paths;
+  vector<int> car_intentions;
+  // the last lane change failed
+  bool waiting;
+};
+
+#endif /* DRIVER_H */
@@ -1,6 +1,12 @@
 #ifndef INFERENCE_H
 #define INFERENCE_H
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 #include "simulation.h"
 #include "car.h"
 
@@ -15,13 +21,84 @@ const vector<string> g_intentions{"cooperative", "aggressive"};
 
 const UMAP<string, int> g_intention2index{{"cooperative", 0}, {"aggressive", 1}};
 
+// a joint intention state, the intention of car i is its i-th digit in the
+// radix of the legal intentions, so one bit per car for two intentions
+typedef uint64_t JointState;
+
+// the speed model of an intention, reference is the oldest speed still
+// observed of the car and spread the standard deviation of its kept speeds
+pff getMeanStandard(float reference, const string& intention, float spread = 0);
+
+//************************************************************************
+// class WorkerPool
+//************************************************************************
+
+/*
+ * threads kept for the life of a filter, so that spreading an observation
+ * over them does not start threads of its own every tick
+ */
+class WorkerPool {
+public:
+  // the caller of run is one of the threads
+  explicit WorkerPool(int threads);
+
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  // task(i) for every i below num_tasks, returns once they are all done
+  void run(int num_tasks, const std::function<void(int)>& task);
+
+private:
+  // the loop of a worker thread
+  void work();
+
+  // the tasks of the current run are claimed through next
+  void claim();
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const std::function<void(int)>* task;
+  int num_tasks;
+  std::atomic<int> next;
+  // workers still on the current run, and the number of runs so far
+  int busy;
+  unsigned int generation;
+  bool stopping;
+  vector<std::thread> workers;
+};
+
 //************************************************************************
 // class JointParticles
 //************************************************************************
 
+/*
+ * particles over the joint intentions of the other cars. The particles are
+ * weighted by the observations, and only resampled once their effective
+ * number falls below resample_threshold of the particles. In the factored
+ * mode every car keeps particles of its own intention and is filtered on its
+ * own, in time linear in the number of cars. It is also used whenever the
+ * joint states do not fit in a JointState. The particles, or the cars when
+ * factored, are spread over threads, and every random number comes from the
+ * seed, so a seed gives the same beliefs with any number of threads.
+ */
 class JointParticles {
 public:
-  JointParticles(int num = 600) : num_particles(num), num_cars(0) {};
+  // with no threads given all the cores are used, and with no seed a random one
+  JointParticles(int num = 600, bool factored = false, float resample_threshold = 0.5, int threads = 0,
+                 unsigned int seed = 0)
+      : num_particles(num),
+        num_cars(0),
+        radix(2),
+        num_states(0),
+        factored(factored),
+        resample_threshold(resample_threshold),
+        resamples(0),
+        num_threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+        seed(seed != 0 ? seed : std::random_device()()),
+        num_observations(0) {};
 
   void initializeUniformly(const Simulation& simulation, const vector<string>& intentions);
 
@@ -29,37 +106,206 @@ public:
 
   void observe(const Simulation& simulation);
 
+  bool isFactored() const { return factored; }
+
+  // times the particles, or those of a car when factored, were resampled
+  int getResamples() const { return resamples; }
+
+  // histogram of the particles, with the intentions spelled out. When
+  // factored, the product of the marginals of the cars, over every joint
+  // state when there are at most MAX_JOINT, else over as many samples
   Counter<vector<string>> getBelief();
 
-  vector<string> sample(Counter<vector<string>>& distribution);
+  // the belief by joint state, empty when factored and the joint states do
+  // not fit in a JointState
+  Counter<JointState> getStateBelief() const;
+
+  // distribution of the intention of one car over the particles, computed
+  // for all the cars once per observation
+  vector<float> getMarginal(int car) const;
+
+  int getIntention(JointState state, int car) const {
+    return radix == 2 ? (state >> car) & 1 : state / place[car] % radix;
+  }
 
-  pff getMeanStandard(queue<float>& history, const string& intention);
+  vector<string> decode(JointState state) const;
 
 private:
+  void initializeFactored();
+
+  void observeJoint(const Simulation& simulation);
+
+  void observeFactored(const Simulation& simulation);
+
+  void updateMarginals();
+
+  void resample(const vector<double>& block_totals);
+
+  std::mt19937 getStream(unsigned int id) const;
+
+  // task(i) for every i below num_tasks, on up to threads threads of the pool
+  void parallelFor(int num_tasks, int threads, const std::function<void(int)>& task);
+
+  static const int MAX_JOINT = 1 << 10;
+
   int num_particles;
   int num_cars;
+  int radix;
+  // radix^car, and the number of joint states, 0 when they do not fit
+  vector<JointState> place;
+  JointState num_states;
+  bool factored;
+  float resample_threshold;
+  int resamples;
+  int num_threads;
+  // made the first time an observation is spread over threads
+  std::unique_ptr<WorkerPool> pool;
+  // the random numbers of an observation come from the seed, the number of
+  // observations so far and the stream of the task
+  unsigned int seed;
+  unsigned int num_observations;
+  static const unsigned int INITIAL_STREAM = 0;
+  static const unsigned int RESAMPLE_STREAM = 1;
+  static const unsigned int CAR_STREAM = 2;
   vector<string> legal_intentions;
   vector<Actor*> cars;
-  Counter<vector<string>> beliefs;
-  vector<vector<string>> particles;
+  Counter<JointState> beliefs;
+  vector<JointState> particles;
+  // normalized weights of the particles, and their logs
+  vector<double> weights;
+  vector<double> log_weights;
+  vector<JointState> resampled;
+  // log likelihood of intention k of car c at c * radix + k
+  vector<double> log_likelihoods;
+  // the factored particles of car c are at [c * num_particles, (c + 1) * num_particles),
+  // and the log weight of its intention k at c * radix + k
+  vector<unsigned char> car_particles;
+  vector<double> car_log_weights;
+  // intention k of car c at c * radix + k
+  vector<float> marginals;
+};
+
+//************************************************************************
+// class ForwardFilter
+//************************************************************************
+
+/*
+ * the exact belief about the intention of every car, filtered on its own.
+ * The cars are observed independently, so the joint belief is the product of
+ * theirs, and an observation costs time linear in the cars and intentions
+ * with no sampling noise. Between observations the intention of a car may
+ * switch by a transition matrix, without one it is kept.
+ */
+class ForwardFilter {
+public:
+  // switch_probability is the chance that a car changes its intention
+  // between two observations, spread evenly over the other intentions. The
+  // default keeps every intention at least that likely, so the belief
+  // forgets old evidence and a car that changes is followed within a few
+  // observations. With 0 the evidence adds up for good
+  ForwardFilter(float switch_probability = 0.01) : switch_probability(switch_probability), num_cars(0), radix(0) {}
+
+  // the chance to go from intention i to j at [i][j], every row sums to 1
+  void setTransitions(const vector<vector<float>>& matrix);
+
+  void initializeUniformly(const Simulation& simulation, const vector<string>& intentions);
+
+  void observe(const Simulation& simulation);
+
+  vector<float> getMarginal(int car) const;
+
+  // the product of the beliefs of the cars when it has at most MAX_JOINT
+  // states, a histogram of as many joint samples from it otherwise
+  Counter<vector<string>> getBelief() const;
+
+private:
+  static const int MAX_JOINT = 1 << 10;
+
+  float switch_probability;
+  int num_cars;
+  int radix;
+  unsigned int num_observations;
+  vector<string> legal_intentions;
+  // from intention i to j at i * radix + j, empty when intentions are kept
+  vector<double> transitions;
+  // intention k of car c at c * radix + k
+  vector<double> beliefs;
+  vector<double> log_likelihoods;
 };
 
-static JointParticles jointInference = JointParticles();
+class Context;
 
 //************************************************************************
 // class MarginalInference
 //************************************************************************
 
+// the belief about the intention of one car, a view of the filter of its
+// context
 class MarginalInference {
 public:
-  MarginalInference(int index, const Simulation& simulation);
-  void initializeUniformly(const Simulation& simulation);
+  MarginalInference(int index, Context& context);
   void observe(const Simulation& simulation);
   vector<float> getBelief();
 
 private:
   vector<string> legal_intentions;
   int index;
+  Context* context;
+};
+
+//************************************************************************
+// class Context
+//************************************************************************
+
+/*
+ * the intention inference of one simulation, the filter of its other cars
+ * and the marginal views of the cars on it. The exact filter is the default,
+ * the particles are kept for models that couple the cars. Every simulation
+ * has its own, so that independent episodes can run side by side.
+ */
+class Context {
+public:
+  enum Engine { EXACT, PARTICLES };
+
+  // a default filter of the engine
+  Context(const Simulation& simulation, Engine engine = EXACT);
+
+  // takes the filter
+  Context(const Simulation& simulation, ForwardFilter* exact);
+
+  Context(const Simulation& simulation, JointParticles* joint);
+
+  ~Context();
+
+  Context(const Context&) = delete;
+  Context& operator=(const Context&) = delete;
+
+  Engine getEngine() const { return joint ? PARTICLES : EXACT; }
+
+  // filter the observations of the simulation made since the last call, so
+  // the cars can all ask and the filter only runs once
+  void observe(const Simulation& simulation);
+
+  // the view of a car, index is its getIndex plus one
+  MarginalInference* getMarginal(int index);
+
+  // distribution of the intention of the car at index, from 0
+  vector<float> getCarBelief(int car) const;
+
+  // only with the PARTICLES engine
+  JointParticles& getJoint() { return *joint; }
+
+  Counter<vector<string>> getBelief();
+
+private:
+  void initialize(const Simulation& simulation);
+
+  std::unique_ptr<ForwardFilter> exact;
+  std::unique_ptr<JointParticles> joint;
+  vector<std::unique_ptr<MarginalInference>> marginals;
+  // version of the observations last filtered, that of an empty table at
+  // first, so observations made before the context are not skipped
+  unsigned int observed;
 };
 
 }  // namespace Inference
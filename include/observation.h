@@ -0,0 +1,87 @@
+//
+//  observation.h
+//  CarGame
+//
+
+#ifndef OBSERVATION_H
+#define OBSERVATION_H
+
+#include "globals.h"
+
+/*
+ * class ObservationTable
+ *
+ * the last CAPACITY observed speeds of every other car, kept as rings in
+ * arrays of all the cars so that a pass over the cars reads them in order.
+ * The reference speed, the oldest one still kept, and the last one are read
+ * in constant time, the mean and the variance of the kept speeds are updated
+ * on every push (Welford).
+ */
+class ObservationTable {
+public:
+  static const int CAPACITY = 11;
+
+  ObservationTable(int num_cars = 0) { resize(num_cars); }
+
+  void resize(int num_cars) {
+    version = 0;
+    values.assign(num_cars * CAPACITY, 0);
+    heads.assign(num_cars, 0);
+    counts.assign(num_cars, 0);
+    means.assign(num_cars, 0);
+    m2s.assign(num_cars, 0);
+  }
+
+  int getNumCars() const { return heads.size(); }
+
+  // the oldest observation gives way once the ring of the car is full
+  void push(int index, float value) {
+    float* ring = &values[index * CAPACITY];
+    int slot = (heads[index] + counts[index]) % CAPACITY;
+    double& mean = means[index];
+    double& m2 = m2s[index];
+    if (counts[index] == CAPACITY) {
+      // the value replaces the oldest one, the count stays
+      double old = ring[slot];
+      double old_mean = mean;
+      mean += (value - old) / CAPACITY;
+      m2 += (value - old) * (value - mean + old - old_mean);
+      if (m2 < 0) m2 = 0;
+      heads[index] = (heads[index] + 1) % CAPACITY;
+    } else {
+      counts[index]++;
+      double delta = value - mean;
+      mean += delta / counts[index];
+      m2 += delta * (value - mean);
+    }
+    ring[slot] = value;
+    version++;
+  }
+
+  // changes with every push
+  unsigned int getVersion() const { return version; }
+
+  int size(int index) const { return counts[index]; }
+
+  // the oldest and the newest observation of a car
+  float getReference(int index) const { return values[index * CAPACITY + heads[index]]; }
+
+  float getLast(int index) const {
+    return values[index * CAPACITY + (heads[index] + counts[index] + CAPACITY - 1) % CAPACITY];
+  }
+
+  // of the kept observations of a car
+  float getMean(int index) const { return means[index]; }
+
+  float getVariance(int index) const { return counts[index] == 0 ? 0 : m2s[index] / counts[index]; }
+
+private:
+  unsigned int version;
+  vector<float> values;
+  vector<unsigned char> heads;
+  vector<unsigned char> counts;
+  vector<double> means;
+  vector<double> m2s;
+};
+
+#endif /* OBSERVATION_H */
@@ -0,0 +1,76 @@
+//
+//  policy.h
+//  CarGame
+//
+
+/*
+ * lane change decision as a Markov decision process, the policy is solved
+ * offline by policy_solver over a discretized situation of the host and the
+ * nearest cars of the target lane, and looked up at runtime
+ */
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "simulation.h"
+
+namespace MDP {
+
+enum Decision { WAIT = 0, CHANGE = 1 };
+
+// discretized situation, a gap of NUM_GAPS - 1 means there is no such car
+struct Situation {
+  int host_speed;
+  int ahead_gap;
+  int ahead_speed;
+  int ahead_intention;
+  int behind_gap;
+  int behind_speed;
+  int behind_intention;
+};
+
+//************************************************************************
+// class PolicyTable
+//************************************************************************
+
+class PolicyTable {
+public:
+  static const int NUM_SPEEDS = 4;
+  // gaps in belief tiles, the last one is no car within reach
+  static const int NUM_GAPS = 5;
+  static const int NUM_INTENTIONS = 2;
+  static const int NUM_STATES = NUM_SPEEDS * (NUM_GAPS * NUM_SPEEDS * NUM_INTENTIONS) *
+                                (NUM_GAPS * NUM_SPEEDS * NUM_INTENTIONS);
+
+  PolicyTable() {}
+
+  bool load(const string& filename);
+
+  bool save(const string& filename) const;
+
+  bool empty() const { return actions.size() == 0; }
+
+  Decision lookup(const Situation& s) const { return Decision(actions[encode(s)]); }
+
+  void assign(const vector<unsigned char>& table) { actions = table; }
+
+  static int encode(const Situation& s);
+
+  static Situation decode(int index);
+
+  static int speedToBucket(float speed);
+
+  // gap in the driving direction, only gaps in [0, reach) have a bucket
+  static int gapToBucket(float gap);
+
+  static float reach() { return (NUM_GAPS - 1) * Globals::constant.BELIEF_TILE_SIZE; }
+
+  // the situation of the host for a change towards the goal lane
+  static Situation observe(const Simulation& simulation, const vector<int>& car_intentions);
+
+private:
+  vector<unsigned char> actions;
+};
+
+}  // namespace MDP
+
+#endif /* POLICY_H */
@@ -0,0 +1,227 @@
+//
+//  replanner.h
+//  CarGame
+//
+
+/*
+ * planning on a worker thread. The control loop hands snapshots of the
+ * simulation to the worker and picks up the plans it publishes, both through
+ * lock-free buffers, so neither side ever waits for the other. After a failed
+ * lane change a second thread can also plan ahead for the next most likely
+ * intentions, so the plan for the updated belief is ready when it is asked.
+ */
+#ifndef REPLANNER_H
+#define REPLANNER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "decision_making.h"
+
+//************************************************************************
+// class TripleBuffer
+//************************************************************************
+
+/*
+ * single writer, single reader hand-off of the latest value. The writer fills
+ * its back slot and swaps it with the middle one, the reader swaps the middle
+ * slot with its front one when it holds something new, so each side always
+ * owns a slot of its own and only the middle index is shared.
+ */
+template <class T>
+class TripleBuffer {
+public:
+  TripleBuffer() : front_index(0), back_index(1), middle(2) {}
+
+  // writer side
+  T& back() { return slots[back_index]; }
+
+  void publish() { back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & INDEX; }
+
+  // reader side, true when a newer value has been published since the last update
+  bool update() {
+    if ((middle.load(std::memory_order_acquire) & FRESH) == 0) return false;
+    front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+
+  T& front() { return slots[front_index]; }
+
+private:
+  static const unsigned char INDEX = 3;
+  static const unsigned char FRESH = 4;
+
+  T slots[3];
+  unsigned char front_index;
+  unsigned char back_index;
+  std::atomic<unsigned char> middle;
+};
+
+//************************************************************************
+// class Replanner
+//************************************************************************
+
+class Replanner {
+public:
+  // what the worker plans from
+  struct Snapshot {
+    std::unique_ptr<Simulation> simulation;
+    vector<int> car_intentions;
+    Counter<vector<string>> belief;
+    int tick;
+  };
+
+  // what the worker publishes, tick and intentions are the ones of its snapshot
+  struct Plan {
+    bool success;
+    bool change;
+    vector<Vector2f> path;
+    vector<vector<Vector2f>> candidates;
+    vector<int> car_intentions;
+    int tick;
+    double plan_ms;
+
+    Plan() : success(false), change(false), tick(-1), plan_ms(0) {}
+  };
+
+  typedef std::function<void(Snapshot&, Plan&)> PlanFunction;
+
+  // speculation is the number of intention hypotheses planned ahead by
+  // speculative_function on a thread of its own, so it must not share state
+  // with function. max_age is the oldest snapshot in ticks a speculative plan
+  // is taken from, its belief is then as old as that of a plan the worker
+  // makes. Plans from snapshots more than staleness_limit ticks old are
+  // dropped, 0 takes every plan
+  Replanner(const PlanFunction& function, const PlanFunction& speculative_function = PlanFunction(),
+            int speculation = 0, int max_age = 3, int staleness_limit = 10);
+
+  ~Replanner();
+
+  Replanner(const Replanner&) = delete;
+  Replanner& operator=(const Replanner&) = delete;
+
+  // hand a copy of the simulation at the tick to the worker, a snapshot the
+  // worker has not started on yet is replaced
+  void request(const Simulation& simulation, const vector<int>& car_intentions,
+               const Counter<vector<string>>& belief, int tick);
+
+  // a requested plan is not published yet
+  bool pending() const { return requested.load() > published.load(); }
+
+  // take the newest published plan at the tick, false when there is none
+  // since the last poll or it is too old
+  bool poll(Plan& plan, int tick);
+
+  // block until the pending plan is published and take it, for the first
+  // plan before the control loop starts, or in a synchronous loop
+  void wait(Plan& plan, int tick);
+
+  // ticks between the snapshot of the plan last taken by poll and the tick
+  int getStaleness(int tick) const { return taken < 0 ? 0 : tick - taken; }
+
+  // the largest staleness of a plan when it was taken
+  int getMaxStaleness() const { return max_staleness; }
+
+  // plans dropped by poll as too old
+  int getDropped() const { return num_dropped; }
+
+  // speculative plans made, and requests answered by one of them
+  int getSpeculations() const { return speculations.load(); }
+
+  int getSpeculationHits() const { return speculation_hits.load(); }
+
+private:
+  void run();
+
+  // the next most likely intentions of the belief after a failed change
+  void queueHypotheses(const Snapshot& snapshot, const Plan& plan);
+
+  // the loop of the speculating thread
+  void speculate();
+
+  bool takeSpeculation(const Snapshot& snapshot, Plan& plan);
+
+  PlanFunction plan_function;
+  PlanFunction speculative_function;
+  TripleBuffer<Snapshot> snapshots;
+  TripleBuffer<Plan> plans;
+  // tick of the latest request and of the latest published plan
+  std::atomic<int> requested;
+  std::atomic<int> published;
+  std::atomic<bool> running;
+  int taken;
+  int max_staleness;
+  int staleness_limit;
+  int num_dropped;
+  int speculation;
+  int max_age;
+  // shared by the worker and the speculating thread. A snapshot the worker
+  // takes ends the speculation on the older one, the plans of hypotheses
+  // started before it are dropped
+  std::mutex speculation_mutex;
+  vector<Snapshot> hypotheses;
+  vector<Plan> speculative;
+  unsigned int generation;
+  std::atomic<int> speculations;
+  std::atomic<int> speculation_hits;
+  std::thread worker;
+  std::thread speculator;
+};
+
+//************************************************************************
+// class ReplanTrigger
+//************************************************************************
+
+/*
+ * decides at each tick whether the followed plan still holds. A replan is
+ * asked for when the path is done, the intentions change, or the path can no
+ * longer be followed. The other cars are predicted from the tick the plan was
+ * taken, with the intentions it was made for. When a car leaves its
+ * prediction, the rest of the path is rolled out again, and only a collision
+ * asks for a replan. While the host waits after a failed lane change, it
+ * replans every interval ticks.
+ */
+class ReplanTrigger {
+public:
+  enum Event { NONE, PATH_END, DEVIATION, BELIEF, INFEASIBLE, TIMEOUT, NUM_EVENTS };
+
+  ReplanTrigger(float tolerance = Globals::constant.BELIEF_TILE_SIZE * 0.5, int interval = 2);
+
+  // a plan made for the intentions is followed from the tick on
+  void reset(const Simulation& simulation, const vector<int>& car_intentions, int tick);
+
+  // called once per tick before the other cars move, after the plan of the
+  // tick is taken, steps the predictions
+  Event check(const Simulation& simulation, const vector<Vector2f>& path,
+              const vector<int>& car_intentions, bool waiting, int tick);
+
+  int getCount(Event event) const { return counts[event]; }
+
+  // ticks without a replan, and deviations the current path still survives
+  int getSkips() const { return counts[NONE]; }
+
+  int getDeviations() const { return deviations; }
+
+  static const char* name(Event event);
+
+private:
+  bool isInfeasible(const Simulation& simulation, const vector<Vector2f>& path) const;
+
+  bool isDeviating(const Simulation& simulation) const;
+
+  bool survives(const Simulation& simulation, const vector<Vector2f>& path, const vector<int>& car_intentions);
+
+  DecisionMaker evaluator;
+  float tolerance;
+  int interval;
+  int reset_tick;
+  vector<int> intentions;
+  vector<std::unique_ptr<Car>> predicted;
+  int counts[NUM_EVENTS];
+  int deviations;
+};
+
+#endif /* REPLANNER_H */
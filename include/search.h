@@ -16,6 +16,7 @@ best
 #ifndef SEARCH_2_H
 #define SEARCH_2_H
 
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <queue>
@@ -33,6 +34,157 @@ typedef std::pair<int, int> pii;
 
 namespace SEARCH {
 
+//******************************************************************************
+// struct SearchStats
+//******************************************************************************
+
+// work done by one search, can be summed up over several searches
+struct SearchStats {
+  unsigned long nodes_expanded;
+  unsigned long successors_generated;
+  unsigned long successors_rejected;
+  unsigned long successors_blocked;
+  unsigned long duplicate_pops;
+  size_t peak_open;
+  size_t peak_closed;
+  unsigned long cache_hits;
+  double elapsed_ms;
+
+  SearchStats()
+      : nodes_expanded(0),
+        successors_generated(0),
+        successors_rejected(0),
+        successors_blocked(0),
+        duplicate_pops(0),
+        peak_open(0),
+        peak_closed(0),
+        cache_hits(0),
+        elapsed_ms(0) {}
+
+  SearchStats& operator+=(const SearchStats& s);
+
+  friend ostream& operator<<(ostream& os, const SearchStats& s);
+};
+
+//******************************************************************************
+// class Occupancy
+//******************************************************************************
+
+/*
+ * time-indexed poses of the other cars, predicted once per decision by
+ * stepping every car under its believed intention, tick 0 is the current
+ * pose and poses are stored as [tick * num_cars + car]
+ */
+class Occupancy {
+public:
+  Occupancy(const Simulation& simulation, const vector<int>& car_intentions,
+            int horizon);
+
+  Occupancy(const Occupancy&) = delete;
+
+  Occupancy& operator=(const Occupancy&) = delete;
+
+  int horizon() const { return num_ticks; }
+
+  size_t numCars() const { return num_cars; }
+
+  // predict more ticks, the stored ticks are not changed
+  void extend(int horizon);
+
+  Vec2f getPos(int tick, int car) const { return positions[tick * num_cars + car]; }
+
+  Vec2f getDir(int tick, int car) const { return dirs[tick * num_cars + car]; }
+
+  // check the footprint against all the cars at the given tick, ticks past
+  // the horizon are not predicted and never collide
+  bool collides(const Vec2f& pos, const vector<Vec2f>& bounds, int tick) const;
+
+private:
+  const Simulation& simulation;
+  vector<int> intentions;
+  // the cars at the last predicted tick
+  vector<std::unique_ptr<Car>> cars;
+  int num_ticks;
+  size_t num_cars;
+  vector<Vec2f> positions;
+  vector<Vec2f> dirs;
+};
+
+//******************************************************************************
+// class PlanCache
+//******************************************************************************
+
+// key of a cached plan: exact start pose, goal and map version. A path
+// searched from another pose is followed differently by the host, so it is
+// never shifted to a nearby start
+struct PlanKey {
+  float x, y;
+  float dir_x, dir_y;
+  float goal_x, goal_y;
+  unsigned int map_version;
+
+  bool operator==(const PlanKey& k) const {
+    return x == k.x && y == k.y && dir_x == k.dir_x && dir_y == k.dir_y &&
+           goal_x == k.goal_x && goal_y == k.goal_y &&
+           map_version == k.map_version;
+  }
+};
+
+struct PlanKeyHash {
+  size_t operator()(const PlanKey& k) const {
+    size_t seed = 0;
+    Globals::hash_combine(seed, k.x);
+    Globals::hash_combine(seed, k.y);
+    Globals::hash_combine(seed, k.dir_x);
+    Globals::hash_combine(seed, k.dir_y);
+    Globals::hash_combine(seed, k.goal_x);
+    Globals::hash_combine(seed, k.goal_y);
+    Globals::hash_combine(seed, k.map_version);
+    return seed;
+  }
+};
+
+/*
+ * bounded LRU cache of raw search results, a host stopped at the same pose, or
+ * planning several goals from it, gets the path without searching again. Only
+ * the predicted traffic is checked again on a hit
+ */
+class PlanCache {
+public:
+  PlanCache(size_t cap = 256) : capacity(cap), num_hits(0), num_misses(0) {}
+
+  bool lookup(const PlanKey& key, vector<Vec2f>& path);
+
+  void insert(const PlanKey& key, const vector<Vec2f>& path);
+
+  void clear() {
+    entries.clear();
+    index.clear();
+  }
+
+  size_t size() const { return entries.size(); }
+
+  unsigned long hits() const { return num_hits; }
+
+  unsigned long misses() const { return num_misses; }
+
+  // a cached path failed validation and has to be searched again
+  void reject(const PlanKey& key);
+
+private:
+  typedef std::pair<PlanKey, vector<Vec2f>> Entry;
+
+  size_t capacity;
+  unsigned long num_hits;
+  unsigned long num_misses;
+  list<Entry> entries;
+  unordered_map<PlanKey, list<Entry>::iterator, PlanKeyHash> index;
+};
+
+//******************************************************************************
+// class Search
+//******************************************************************************
+
 struct State {
   pvff current;
   list<char> actions;
@@ -69,7 +221,8 @@ struct State {
 
 class Search {
 public:
-  Search(Simulation* m, const Vec2f& goal);
+  Search(Simulation* m, const Vec2f& goal, PlanCache* cache = nullptr,
+         const Occupancy* occupancy = nullptr, bool trace = false);
 
   State search();
 
@@ -88,6 +241,14 @@ public:
 
   void smooth();
 
+  const SearchStats& getStats() const { return stats; }
+
+  // expanded cells as (row, col) in expansion order, empty unless traced
+  const vector<pii>& getTrace() const { return trace; }
+
+  // write the trace as "row,col" lines for offline heatmaps
+  void dumpTrace(ostream& os) const;
+
 private:
   Simulation* simulation;
   int unitdistanace;
@@ -96,6 +257,12 @@ private:
   float cost;
   vector<float> angle;
   vector<Vec2f> pa;
+  SearchStats stats;
+  const Occupancy* occupancy;
+  // host ticks needed to travel one search step
+  float ticks_per_step;
+  bool tracing;
+  vector<pii> trace;
   // enum {left90, left45, strainght, right45, right90};
   // float angle[9] = {60, 45, 30, 15, 0, -15, -30, -45, -60};
   // enum {east, north, west, south};
@@ -110,6 +277,16 @@ private:
 
   vector<Vec2f> path(list<char>&);
 
+  // check the enlarged footprint of a car at pos heading to dir
+  bool isFeasible(const Vec2f& pos, const Vec2f& dir);
+
+  // check the footprint against the predicted cars at the given search depth
+  bool isOccupied(const Vec2f& pos, const Vec2f& dir, int depth);
+
+  PlanKey planKey();
+
+  bool fromCache(PlanCache* cache, const PlanKey& key);
+
   //"The Manhattan distance heuristic for a PositionSearchProblem"
   inline float manhattanHeuristic(const Vec2f& position) {
     Vec2f xy1 = position;
@@ -11,7 +11,9 @@
 
 #include "KdTree.hpp"
 #include "layout.h"
+#include "world.h"
 #include "vec2D.h"
+#include "observation.h"
 #include "inference.h"
 #include "car.h"
 
@@ -21,86 +23,13 @@ using std::vector;
 // Forward declaration
 class Actor;
 class Simulation;
+struct ActorState;
 namespace Inference {
   class JointParticles;
   class MarginalInference;
+  class Context;
 }
 
-//************************************************************************
-// class Line
-//************************************************************************
-
-struct Line {
-  int x1, y1, x2, y2;
-
-  Line(float _x1, float _y1, float _x2, float _y2)
-      : x1(_x1), y1(_y1), x2(_x2), y2(_y2) {}
-
-  Line(vector<int>& row) {
-    x1 = row[0] * (Globals::constant.BLOCK_TILE_SIZE);
-    y1 = row[1] * (Globals::constant.BLOCK_TILE_SIZE);
-    x2 = row[2] * (Globals::constant.BLOCK_TILE_SIZE);
-    y2 = row[3] * (Globals::constant.BLOCK_TILE_SIZE);
-  }
-
-  Vector2f getstart() { return Vector2f(x1, y1); }
-
-  Vector2f getend() { return Vector2f(x2, y2); }
-};
-
-//************************************************************************
-// class Block
-//************************************************************************
-
-class Block {
-public:
-  Block() : startx(0), starty(0), endx(0), endy(0) {}
-
-  Block(vector<int>& blockdata) {
-    assert(blockdata.size() == 4);
-    int unit = Globals::constant.BLOCK_TILE_SIZE;
-    startx = blockdata[0] * unit;
-    starty = blockdata[1] * unit;
-    endx = blockdata[2] * unit;
-    endy = blockdata[3] * unit;
-    centerX = (startx + endx) / 2.0;
-    centerY = (starty + endy) / 2.0;
-  }
-
-  Vector2f getCenter() const { return Vector2f(centerX, centerY); }
-
-  int getWidth() const { return abs(endx - startx); }
-
-  int getHeight() const { return abs(endy - starty); }
-
-  bool containsPoint(int x, int y) const {
-    if (x < startx) return false;
-    if (y < starty) return false;
-    if (x > endx) return false;
-    if (y > endy) return false;
-    return true;
-  }
-
-  // larger one
-  bool containsPointLarger(int x, int y) const {
-    int size = 2;
-    int startx1 = startx - size;
-    int starty1 = starty - size;
-    int endx1 = endx + size;
-    int endy1 = endy + size;
-    if (x < startx1) return false;
-    if (y < starty1) return false;
-    if (x > endx1) return false;
-    if (y > endy1) return false;
-    return true;
-  }
-
-private:
-  int startx, starty;
-  int endx, endy;
-  float centerX, centerY;
-};
-
 //************************************************************************
 // class Simulation
 //************************************************************************
@@ -109,40 +38,44 @@ class Simulation {
 public:
   Simulation(Layout&);
 
+  Simulation(std::shared_ptr<const World> world);
+
   Simulation(const Simulation&);
 
   ~Simulation();
 
   // get the properties for the simulation class
-  int getWidth() const { return layout.getWidth(); }
+  int getWidth() const { return world->getWidth(); }
 
-  int getHeight() const { return layout.getHeight(); }
+  int getHeight() const { return world->getHeight(); }
 
-  int getBeliefRows() const { return layout.getBeliefRows(); }
+  int getBeliefRows() const { return world->getBeliefRows(); }
 
-  int getBeliefCols() const { return layout.getBeliefCols(); }
+  int getBeliefCols() const { return world->getBeliefCols(); }
 
-  const vector<Block*>& getBlocks() const { return blocks; }
+  const vector<Block*>& getBlocks() const { return world->getBlocks(); }
 
-  const vector<Line*>& getLine() const { return lines; }
+  const vector<Line*>& getLine() const { return world->getLines(); }
 
   const vector<Actor*>& getAllCars() const { return all_cars; }
 
   const vector<Actor*>& getOtherCars() const { return other_cars; }
 
-  vector<Vector2f> getIntersectionCenter();
+  vector<Vector2f> getIntersectionCenter() const;
+
+  const vector<Block*>& getIntersectionGraph() const { return world->getIntersections(); }
 
-  vector<Block*>& getIntersectionGraph() { return interSections; }
+  const vector<Block*>& getAgentGraph() const { return world->getAgentGraph(); }
 
-  vector<Block*>& getAgentGraph() { return agentGraph; }
+  const vector<Block*>& getHostGraph() const { return world->getHostGraph(); }
 
-  vector<Block*>& getHostGraph() { return hostGraph; }
+  const vector<Block*>& getAllGraph() const { return world->getAllGraph(); }
 
-  vector<Block*>& getAllGraph() { return allGraph; }
+  const Block* getIntersection(float x, float y) const { return world->getIntersection(x, y); }
 
-  Block* getIntersection(float x, float y) const;
+  const Block& getGoal() const { return world->getGoal(); }
 
-  Block& getGoal() const { return *goal; }
+  const std::shared_ptr<const World>& getWorld() const { return world; }
 
   Actor* getHost() const { return host; }
 
@@ -153,42 +86,44 @@ public:
 
   bool checkCollision(Actor* car) const;
 
-  bool inBounds(float x, float y) const;
+  bool inBounds(float x, float y) const { return world->inBounds(x, y); }
 
-  bool inBoundsLarger(float x, float y) const;
+  bool inBoundsLarger(float x, float y) const { return world->inBoundsLarger(x, y); }
 
   bool inIntersection(float x, float y) const;
 
   int getIndex(const Actor* car) const { return car2index.at((size_t)car); }
 
-private:
-  Layout& layout;
-  Block* goal;
-  Actor* host;
-  // vector<vector<int>> othercardata;
-  vector<Block*> blocks;
-  vector<Line*> lines;
-  vector<Actor*> all_cars;
-  vector<Actor*> other_cars;
-  vector<Block*> interSections;
-  vector<Block*> agentGraph;
-  vector<Block*> hostGraph;
-  vector<Block*> allGraph;
-  UMAP<size_t, int> car2index;
+  // observed speeds of the other cars, by getIndex
+  ObservationTable& getObservations() { return observations; }
 
-  void clearBlocks(vector<Block*>& blocks);
+  const ObservationTable& getObservations() const { return observations; }
 
-  void initBlocks();
+  // the intention inference about the other cars, made on first use. It is
+  // a belief about the simulation rather than part of it, so it is not
+  // copied, and it can be updated from a const simulation
+  Inference::Context& getInference() const;
 
-  void initLines();
+  // use the given context from now on, the simulation takes it
+  void setInference(Inference::Context* context);
 
-  void initIntersections();
+  // save and restore the dynamic state of all the cars, the static map is
+  // shared between copies and is not part of the snapshot
+  void saveState(vector<ActorState>& state) const;
 
-  void initGraphs();
+  void restoreState(const vector<ActorState>& state);
 
-  // void initOtherCars();
+  // version of the static obstacles, differs for every world
+  unsigned int getMapVersion() const { return world->getVersion(); }
 
-  // void getStartNode();
+private:
+  std::shared_ptr<const World> world;
+  Actor* host;
+  vector<Actor*> all_cars;
+  vector<Actor*> other_cars;
+  UMAP<size_t, int> car2index;
+  ObservationTable observations;
+  mutable std::unique_ptr<Inference::Context> inference;
 };
 
 #endif /* MODEL_H */
@@ -60,42 +60,4 @@ void drawPolygon(vector<Vector2f>& polygonvertices) {
   delete[] vertices;
 }
 
-void observe(Host* host, const Simulation& simulation) {
-  host->makeObservation(simulation);
-  vector<Actor*> cars = simulation.getOtherCars();
-  for (int i = 0; i < cars.size(); i++) {
-    Car* car = dynamic_cast<Car*>(cars[i]);
-    int index = simulation.getIndex(car);
-    Inference::MarginalInference* inference = car->getInference(index + 1, simulation);
-    inference->observe(simulation);
-  }
-}
-
-vector<int> infer(const Simulation& simulation) {
-  Host* host = dynamic_cast<Host*>(simulation.getHost());
-  vector<int> car2intention;
-  observe(host, simulation);
-
-  // beliefs = []
-  vector<string> colors{"orange", "red"};
-  vector<Actor*> cars = simulation.getOtherCars();
-  for (int i = 0; i < cars.size(); i++) {
-    Car* car = dynamic_cast<Car*>(cars[i]);
-    int index = simulation.getIndex(car);
-    vector<float> belief = car->getInference(index + 1, simulation)->getBelief();
-
-    int max_index = 0;
-    for (int j = 0; j < belief.size(); j++) {
-      if (belief[j] > belief[max_index]) {
-        max_index = j;
-      }
-    }
-
-    car2intention.push_back(max_index);
-    display.colorChange(car, colors[max_index]);
-  }
-
-  return car2intention;
-}
-
 #endif /* UTIL_H */
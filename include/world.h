@@ -0,0 +1,185 @@
+//
+//  world.h
+//  CarGame
+//
+
+#ifndef WORLD_H
+#define WORLD_H
+
+#include "globals.h"
+#include "layout.h"
+#include "vec2D.h"
+
+using std::string;
+using std::vector;
+
+//************************************************************************
+// class Line
+//************************************************************************
+
+struct Line {
+  int x1, y1, x2, y2;
+
+  Line(float _x1, float _y1, float _x2, float _y2)
+      : x1(_x1), y1(_y1), x2(_x2), y2(_y2) {}
+
+  Line(vector<int>& row) {
+    x1 = row[0] * (Globals::constant.BLOCK_TILE_SIZE);
+    y1 = row[1] * (Globals::constant.BLOCK_TILE_SIZE);
+    x2 = row[2] * (Globals::constant.BLOCK_TILE_SIZE);
+    y2 = row[3] * (Globals::constant.BLOCK_TILE_SIZE);
+  }
+
+  Vector2f getstart() { return Vector2f(x1, y1); }
+
+  Vector2f getend() { return Vector2f(x2, y2); }
+};
+
+//************************************************************************
+// class Block
+//************************************************************************
+
+class Block {
+public:
+  Block() : startx(0), starty(0), endx(0), endy(0) {}
+
+  Block(vector<int>& blockdata) {
+    assert(blockdata.size() == 4);
+    int unit = Globals::constant.BLOCK_TILE_SIZE;
+    startx = blockdata[0] * unit;
+    starty = blockdata[1] * unit;
+    endx = blockdata[2] * unit;
+    endy = blockdata[3] * unit;
+    centerX = (startx + endx) / 2.0;
+    centerY = (starty + endy) / 2.0;
+  }
+
+  Vector2f getCenter() const { return Vector2f(centerX, centerY); }
+
+  int getStartX() const { return startx; }
+
+  int getStartY() const { return starty; }
+
+  int getEndX() const { return endx; }
+
+  int getEndY() const { return endy; }
+
+  int getWidth() const { return abs(endx - startx); }
+
+  int getHeight() const { return abs(endy - starty); }
+
+  bool containsPoint(int x, int y) const {
+    if (x < startx) return false;
+    if (y < starty) return false;
+    if (x > endx) return false;
+    if (y > endy) return false;
+    return true;
+  }
+
+  // larger one
+  bool containsPointLarger(int x, int y) const {
+    int size = 2;
+    int startx1 = startx - size;
+    int starty1 = starty - size;
+    int endx1 = endx + size;
+    int endy1 = endy + size;
+    if (x < startx1) return false;
+    if (y < starty1) return false;
+    if (x > endx1) return false;
+    if (y > endy1) return false;
+    return true;
+  }
+
+private:
+  int startx, starty;
+  int endx, endy;
+  float centerX, centerY;
+};
+
+//************************************************************************
+// class World
+//************************************************************************
+
+/*
+ * immutable static part of a simulation: the map, the goal and the initial
+ * cars of a layout, it owns its blocks and is shared by all the copies of
+ * a simulation through a shared_ptr
+ */
+class World {
+public:
+  World(Layout& layout);
+
+  World(const World&) = delete;
+
+  World& operator=(const World&) = delete;
+
+  ~World();
+
+  int getWidth() const { return width; }
+
+  int getHeight() const { return height; }
+
+  int getBeliefRows() const { return height / Globals::constant.BELIEF_TILE_SIZE; }
+
+  int getBeliefCols() const { return width / Globals::constant.BELIEF_TILE_SIZE; }
+
+  const vector<Block*>& getBlocks() const { return blocks; }
+
+  const vector<Line*>& getLines() const { return lines; }
+
+  const vector<Block*>& getIntersections() const { return interSections; }
+
+  const vector<Block*>& getAgentGraph() const { return agentGraph; }
+
+  const vector<Block*>& getHostGraph() const { return hostGraph; }
+
+  const vector<Block*>& getAllGraph() const { return allGraph; }
+
+  const Block& getGoal() const { return goal; }
+
+  Vector2f getHostStart() const { return host_start; }
+
+  const string& getHostDir() const { return host_dir; }
+
+  const vector<vector<int>>& getOtherData() const { return other_data; }
+
+  // unique for every world, used to key the results derived from the map
+  unsigned int getVersion() const { return version; }
+
+  bool inBounds(float x, float y) const;
+
+  bool inBoundsLarger(float x, float y) const;
+
+  const Block* getIntersection(float x, float y) const;
+
+private:
+  enum { BLOCKED = 1, BLOCKED_LARGER = 2 };
+
+  int width;
+  int height;
+  unsigned int version;
+  Block goal;
+  Vector2f host_start;
+  string host_dir;
+  vector<vector<int>> other_data;
+  vector<Block*> blocks;
+  vector<Line*> lines;
+  vector<Block*> interSections;
+  vector<Block*> agentGraph;
+  vector<Block*> hostGraph;
+  vector<Block*> allGraph;
+  // one byte per pixel with the BLOCKED flags
+  vector<unsigned char> raster;
+  // intersections overlapping each block tile, in their original order
+  int index_cols;
+  int index_rows;
+  vector<vector<int>> intersection_index;
+
+  void clearBlocks(vector<Block*>& blocks);
+
+  void initRaster();
+
+  void initIntersectionIndex();
+};
+
+#endif /* WORLD_H */
@@ -0,0 +1,177 @@
+#include "bandit.h"
+
+namespace BANDIT {
+
+// scale of the UCB1 exploration term, about the range of the path scores
+static const double EXPLORATION = 100;
+
+static double elapsedMs(const std::chrono::steady_clock::time_point& begin) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//******************************************************************************
+// Planner member functions
+//******************************************************************************
+
+constexpr float Planner::COLLISION_REWARD;
+constexpr float Planner::WAIT_REWARD;
+
+Planner::Planner(int threads, int iterations, unsigned int seed, double budget_ms)
+    : num_threads(threads), max_iterations(iterations), seed(seed), budget_ms(budget_ms), round(0) {
+  if (num_threads <= 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool Planner::getPath(const Simulation& simulation, DecisionMaker& decision, vector<Vec2f>& final_path,
+                      vector<int>& car_intentions, const Counter<vector<string>>& belief) {
+  // the candidates are searched against the most likely intentions
+  vector<string> legal_actions = decision.generateLegalActions(simulation);
+  SEARCH::Occupancy occupancy(simulation, car_intentions, DecisionMaker::m_prediction_horizon);
+  vector<vector<Vec2f>>& paths = decision.generatePaths(simulation, legal_actions, &occupancy);
+
+  if (paths.size() == 0) {
+    final_path.clear();
+    return false;
+  }
+
+  // before the first observation the most likely intentions are all we have
+  Counter<vector<string>> point;
+  if (belief.size() == 0) {
+    vector<string> intentions;
+    for (int intention : car_intentions) intentions.push_back(Inference::g_intentions[intention]);
+    point[intentions] = 1;
+  }
+
+  // like getPath, waiting keeps the first candidate which stays in the lane,
+  // and choosing that one is no change either
+  int best = plan(simulation, paths, belief.size() == 0 ? point : belief);
+  final_path = paths[std::max(best, 0)];
+  return best > 0;
+}
+
+int Planner::plan(const Simulation& simulation, const vector<vector<Vec2f>>& candidates,
+                  const Counter<vector<string>>& belief) {
+  arms.assign(candidates.size() + 1, ActionStats());
+  if (candidates.size() == 0) return -1;
+
+  // joint intentions in a fixed order, so that a seed gives the same samples
+  int num_cars = simulation.getOtherCars().size();
+  vector<std::pair<vector<string>, float>> elems;
+  for (const auto& item : belief)
+    if (item.first.size() == num_cars && item.second > 0) elems.push_back(item);
+  std::sort(elems.begin(), elems.end());
+
+  samples.clear();
+  float total = 0;
+  for (const auto& item : elems) {
+    Sample sample;
+    for (const string& intention : item.first)
+      sample.intentions.push_back(Inference::g_intention2index.at(intention));
+    total += item.second;
+    sample.cumulative = total;
+    samples.push_back(sample);
+  }
+
+  // without a usable belief every car is taken as aggressive
+  if (samples.size() == 0) {
+    Sample sample;
+    sample.intentions.assign(num_cars, Inference::aggressive);
+    sample.cumulative = 1;
+    samples.push_back(sample);
+  }
+
+  // every thread pulls the arms on its own, the statistics only meet when
+  // they are summed
+  vector<vector<ActionStats>> stats(num_threads);
+  vector<std::thread> threads;
+  for (int i = 1; i < num_threads; i++)
+    threads.push_back(std::thread(&Planner::worker, this, i, std::cref(simulation),
+                                  std::cref(candidates), std::ref(stats[i])));
+  worker(0, simulation, candidates, stats[0]);
+  for (auto& thread : threads) thread.join();
+  round++;
+
+  for (const auto& thread_stats : stats) {
+    for (int a = 0; a < arms.size(); a++) {
+      arms[a].visits += thread_stats[a].visits;
+      arms[a].value += thread_stats[a].value;
+    }
+  }
+
+  // the best mean reward, waiting is the last action and loses ties
+  int best = -1;
+  double best_mean = -inf;
+  for (int a = 0; a < arms.size(); a++) {
+    if (arms[a].visits > 0 && arms[a].mean() > best_mean) {
+      best = a;
+      best_mean = arms[a].mean();
+    }
+  }
+
+  if (best == candidates.size()) return -1;
+  return best;
+}
+
+/*
+ * the host is rolled out against the predicted cars of the sampled
+ * intentions. Both only depend on the intentions, so a prediction and a
+ * score are computed once per worker and reused by later samples.
+ */
+void Planner::worker(int id, const Simulation& simulation, const vector<vector<Vec2f>>& candidates,
+                     vector<ActionStats>& stats) const {
+  std::mt19937 rng(seed + round * num_threads + id);
+  std::uniform_real_distribution<float> uniform(0, samples.back().cumulative);
+  auto begin = std::chrono::steady_clock::now();
+
+  Simulation sim(simulation);
+  Actor* host = sim.getHost();
+  ActorState start;
+  host->saveState(start);
+  DecisionMaker evaluator;
+
+  int num_actions = candidates.size() + 1;
+  int wait = candidates.size();
+  stats.assign(num_actions, ActionStats());
+  vector<std::unique_ptr<SEARCH::Occupancy>> predictions(samples.size());
+  vector<vector<float>> scores(samples.size(), vector<float>(candidates.size(), NAN));
+
+  for (int n = 0; n < max_iterations; n++) {
+    if (budget_ms > 0 && n >= num_actions && elapsedMs(begin) > budget_ms) break;
+
+    // UCB1, every action is tried once first
+    int action = 0;
+    double best_ucb = -inf;
+    for (int a = 0; a < num_actions; a++) {
+      if (stats[a].visits == 0) {
+        action = a;
+        break;
+      }
+      double ucb = stats[a].mean() + EXPLORATION * sqrt(log(double(n)) / stats[a].visits);
+      if (ucb > best_ucb) {
+        action = a;
+        best_ucb = ucb;
+      }
+    }
+
+    float reward = WAIT_REWARD;
+    if (action != wait) {
+      float choice = uniform(rng);
+      int s = 0;
+      while (s < samples.size() - 1 && choice > samples[s].cumulative) s++;
+
+      float& score = scores[s][action];
+      if (std::isnan(score)) {
+        host->restoreState(start);
+        if (!predictions[s])
+          predictions[s].reset(
+              new SEARCH::Occupancy(sim, samples[s].intentions, DecisionMaker::m_prediction_horizon));
+        score = evaluator.rollout(sim, candidates[action], *predictions[s]);
+      }
+      reward = score == -inf ? COLLISION_REWARD : score;
+    }
+
+    stats[action].visits++;
+    stats[action].value += reward;
+  }
+}
+
+}  // namespace BANDIT
@@ -26,6 +26,24 @@ void Actor::setup() {
   max_accler = 2.0;
 }
 
+void Actor::saveState(ActorState& state) const {
+  state.pos = pos;
+  state.velocity = velocity;
+  state.dir = dir;
+  state.wheel_angle = wheel_angle;
+  state.node_id = 0;
+  state.pre = -1;
+  state.timer = 0;
+  state.stop_flag = false;
+}
+
+void Actor::restoreState(const ActorState& state) {
+  pos = state.pos;
+  velocity = state.velocity;
+  dir = state.dir;
+  wheel_angle = state.wheel_angle;
+}
+
 void Actor::turnCarTowardsWheels() {
   if (velocity.Length() > 0.0) {
     velocity.rotate(wheel_angle);
@@ -108,6 +126,37 @@ vector<Vector2f> Actor::getBounds(Actor& car, float LEN, float WID) {
   return bounds;
 }
 
+vector<Vector2f> Actor::predictBounds(float angle, float speed) const {
+  // setWheelAngle
+  angle = std::max(-max_wheel_angle, std::min(angle, max_wheel_angle));
+
+  // setVelocity
+  Vector2f new_velocity = Vector2f(dir[0], dir[1]);
+  new_velocity.normalized();
+  new_velocity *= speed;
+
+  // turnCarTowardsWheels and move
+  Vector2f new_dir = dir;
+  if (new_velocity.Length() > 0.0) {
+    new_velocity.rotate(angle);
+    new_dir = Vector2f(new_velocity[0], new_velocity[1]);
+    new_dir.normalized();
+  }
+  Vector2f new_pos = pos + new_velocity;
+
+  // getBounds
+  new_dir.normalized();
+  Vector2f perp_dir = new_dir.perpendicular();
+
+  vector<Vector2f> bounds;
+  bounds.push_back(new_pos + new_dir * float(LENGTH / 2) + perp_dir * float(WIDTH / 2));
+  bounds.push_back(new_pos + new_dir * float(LENGTH / 2) - perp_dir * float(WIDTH / 2));
+  bounds.push_back(new_pos - new_dir * float(LENGTH / 2) + perp_dir * float(WIDTH / 2));
+  bounds.push_back(new_pos - new_dir * float(LENGTH / 2) - perp_dir * float(WIDTH / 2));
+
+  return bounds;
+}
+
 // http://www.gamedev.net/page/resources/_/technical/game-programming/2d-rotated-rectangle-collision-r2604
 bool Actor::collides(const Vector2f& otherPos,
                      const vector<Vector2f>& otherBounds) {
@@ -200,6 +249,23 @@ void Host::setup() {
   min_speed = 1;
 }
 
+void Host::saveState(ActorState& state) const {
+  Actor::saveState(state);
+  state.node_id = node_id;
+  state.pre = pre;
+}
+
+void Host::restoreState(const ActorState& state) {
+  Actor::restoreState(state);
+  node_id = state.node_id;
+  pre = state.pre;
+}
+
+void Host::resetPath() {
+  node_id = 0;
+  pre = -1;
+}
+
 void Host::autonomousAction(const vector<Vector2f>& path, const Simulation& simulation, kdtree::kdtree<point<float>>* tree = nullptr) {
   if (path.size() == 0) return;
 
@@ -263,8 +329,9 @@ UMAP<string, float> Host::getAutonomousActions(const vector<Vector2f>& path,
   UMAP<string, float> output;
   if (node_id > path.size()) node_id = 0;
 
-  static unsigned int timer = 0;
-  static bool stop_flag = false;
+  // per thread, planner workers roll out their own hosts
+  static thread_local unsigned int timer = 0;
+  static thread_local bool stop_flag = false;
 
   // set the timer to control time
   if (timer < 30 && stop_flag) {
@@ -318,7 +385,7 @@ UMAP<string, float> Host::getAutonomousActions(const vector<Vector2f>& path,
   } else {
     nextId = node_id + 1;
     if (node_id >= path.size()) node_id = pre;
-    if (nextId > path.size()) nextId = node_id;
+    if (nextId >= path.size()) nextId = node_id;
   }
 
   Vector2f nextpos = path[nextId];
@@ -359,7 +426,7 @@ UMAP<string, float> Host::getAutonomousActions(const vector<Vector2f>& path,
   Vector2f vectogoal;
   nextId = node_id + 1;
   if (node_id >= path.size()) node_id = pre;
-  if (nextId > path.size()) nextId = node_id;
+  if (nextId >= path.size()) nextId = node_id;
 
   Vector2f nextpos = path[nextId];
 
@@ -388,16 +455,13 @@ UMAP<string, float> Host::getAutonomousActions(const vector<Vector2f>& path,
   return output;
 }
 
-void Host::makeObservation(const Simulation& simulation) {
-  vector<Actor*> cars = simulation.getOtherCars();
-  for (const auto& car : cars) {
+void Host::makeObservation(Simulation& simulation) {
+  ObservationTable& observations = simulation.getObservations();
+  for (Actor* car : simulation.getOtherCars()) {
     Vector2f obsv = dynamic_cast<Car*>(car)->getObservation();
     float obs = obsv.Length();
     obs = obs > 0 ? obs : 0;
-    if (dynamic_cast<Car*>(car)->history.size() > 10) {
-      dynamic_cast<Car*>(car)->history.pop();
-    }
-    dynamic_cast<Car*>(car)->history.push(obs);
+    observations.push(simulation.getIndex(car), obs);
   }
 }
 
@@ -411,9 +475,18 @@ void Car::setup() {
   friction = 1;
   max_wheel_angle = 45;
   max_accler = 1.4;
-  history = std::queue<float>();
-  has_inference = false;
-  inference = nullptr;
+}
+
+void Car::saveState(ActorState& state) const {
+  Actor::saveState(state);
+  state.timer = timer;
+  state.stop_flag = stop_flag;
+}
+
+void Car::restoreState(const ActorState& state) {
+  Actor::restoreState(state);
+  timer = state.timer;
+  stop_flag = state.stop_flag;
 }
 
 // path, tree are not used in this function
@@ -494,11 +567,5 @@ void Car::autonomousAction(const vector<Vector2f>& path, const Simulation& simul
 
 Inference::MarginalInference* Car::getInference(int index,
                                                 const Simulation& simulation) {
-  if (!has_inference) {
-    inference = new Inference::MarginalInference(index, simulation);
-    has_inference = true;
-    return inference;
-  }
-
-  return inference;
+  return simulation.getInference().getMarginal(index);
 }
@@ -12,8 +12,10 @@ vector<std::string> DecisionMaker::m_host_actions = {
   2. distance to goal
   3. distance to the neareast other cars, if it is two close, the score is less
 */
-vector<vector<Vec2f>>& DecisionMaker::generatePaths(const Simulation& simulation, vector<string>& legal_actions) {
+vector<vector<Vec2f>>& DecisionMaker::generatePaths(const Simulation& simulation, vector<string>& legal_actions,
+                                                    const SEARCH::Occupancy* occupancy) {
   if (paths.size() > 0) paths.clear();
+  search_stats = SEARCH::SearchStats();
 
   Simulation sim = simulation;
   Actor* host = sim.getHost();
@@ -30,14 +32,16 @@ vector<vector<Vec2f>>& DecisionMaker::generatePaths(const Simulation& simulation
     Vec2f host_pos(host->getPos() + ndir * float(Globals::constant.BELIEF_TILE_SIZE));
 
     Vec2f des_pos(host_pos.x + 50, host->getPos().y);
-    SEARCH::Search search(&sim, des_pos);
+    SEARCH::Search search(&sim, des_pos, &plan_cache, occupancy);
     vector<Vec2f> path = search.path();
+    search_stats += search.getStats();
     paths.push_back(path);
 
     for (float deltax = 0; deltax < 80; deltax += 10) {
       Vec2f des_pos(host_pos.x + deltax, host_pos.y);
-      SEARCH::Search search(&sim, des_pos);
+      SEARCH::Search search(&sim, des_pos, &plan_cache, occupancy);
       vector<Vec2f> path = search.path();
+      search_stats += search.getStats();
       paths.push_back(path);
     }
   }
@@ -74,56 +78,366 @@ void DecisionMaker::applyAction(const Simulation& simulation, int index, const s
 
 float DecisionMaker::evaluatePath(const Simulation& simulation, const vector<Vec2f>& path, vector<int>& car_intentions) {
   Simulation sim(simulation);
-  float score = 0.0;
+  SEARCH::Occupancy occupancy(simulation, car_intentions, m_prediction_horizon);
+  return rollout(sim, path, occupancy);
+}
+
+// only the host is stepped, the other cars are read from the prediction
+// shared by all the candidates of a decision
+float DecisionMaker::rollout(Simulation& sim, const vector<Vec2f>& path, SEARCH::Occupancy& occupancy) {
   Actor* host = sim.getHost();
+  host->resetPath();
   Vec2f host_pos = host->getPos();
+  int tick = 0;
 
   // Criteria 1: collision checking
   while (abs(host_pos.x - path[path.size() - 1].x) > 5) {
     // check in the each update (position) if there is collision
     host->autonomousAction(path, sim, 1);
     host->update();
+    tick++;
 
-    for (int i = 0; i < sim.getOtherCars().size(); i++) {
-      Actor* car = sim.getOtherCars()[i];
-      car->autonomousAction(path, sim, car_intentions[i]);
-      car->update();
-    }
-
-    if (sim.checkCollision(host)) return -inf;
+    if (tick > occupancy.horizon()) occupancy.extend(2 * tick);
+    if (checkCollision(host, sim, occupancy, tick)) return -inf;
 
     host_pos = host->getPos();
   }
 
+  return finishRollout(host, sim, path, occupancy, tick);
+}
+
+// check and score the end of a path, the host is moved onto the end point
+float DecisionMaker::finishRollout(Actor* host, const Simulation& sim, const vector<Vec2f>& path,
+                                   const SEARCH::Occupancy& occupancy, int tick) const {
   // check in the last update (position) if there is collision
   host->setPos(path[path.size() - 1]);
-  if (sim.checkCollision(host)) return -inf;
+  if (checkCollision(host, sim, occupancy, tick)) return -inf;
 
   // even if there is no collision but still need to avoid too close
-  if (isCloseToOtherCar(host, sim)) return -inf;
+  if (isCloseToOtherCar(host, occupancy, tick)) return -inf;
+
+  return scoreEndpoint(host->getPos(), sim.getGoal().getCenter());
+}
 
-  Vector2f goal = simulation.getGoal().getCenter();
+// score of a collision free path, it only depends on the end point and so is
+// also the exact upper bound of a path before its rollout
+float DecisionMaker::scoreEndpoint(const Vec2f& end, const Vec2f& goal) {
+  float score = 0.0;
 
   // Criteria 2: distance to goal
   // The final position gets closer to the goal position,
   // the path gets higher score.
-  score += 100 * (1 - abs(goal[0] - host->getPos()[0]) / 960); // score of x in [0, 100]
-  score += 100 * (1 - abs(goal[1] - host->getPos()[1]) / 100); // score of y in [0, 100]
+  score += 100 * (1 - abs(goal[0] - end[0]) / 960); // score of x in [0, 100]
+  score += 100 * (1 - abs(goal[1] - end[1]) / 100); // score of y in [0, 100]
 
   return score;
 }
 
+// candidates reading the same waypoints from node_id on drive the host the
+// same way in the next tick
+static bool isSameStep(const vector<Vec2f>& a, const vector<Vec2f>& b, int node_id) {
+  if (a == b) return true;
+  // near the end the controller also depends on the path length
+  if (a.size() <= node_id + 2 || b.size() <= node_id + 2) return false;
+  return a[node_id + 1] == b[node_id + 1] && a[node_id + 2] == b[node_id + 2];
+}
+
+vector<float> DecisionMaker::evaluatePaths(const Simulation& simulation, const vector<vector<Vec2f>>& candidates,
+                                           vector<int>& car_intentions) {
+  Simulation sim(simulation);
+  SEARCH::Occupancy occupancy(simulation, car_intentions, m_prediction_horizon);
+  RolloutBatch batch(candidates, occupancy, false);
+  evaluatePaths(sim, batch);
+  return batch.scores;
+}
+
+// with the same score the lower index wins, like the scan in getPath
+bool DecisionMaker::RolloutBatch::canBeat(int c) const {
+  if (!prune || best < 0) return true;
+  return bounds[c] > scores[best] || (bounds[c] == scores[best] && c < best);
+}
+
+/*
+ * all the candidates are advanced in lockstep, one lane per group of
+ * candidates that still share their prefix, so every tick reads one row of
+ * the predicted traffic for all the lanes. A lane splits when the waypoints
+ * of its candidates differ and retires when they finish, collide or can not
+ * beat the incumbent any more.
+ */
+void DecisionMaker::evaluatePaths(Simulation& sim, RolloutBatch& batch) {
+  const vector<vector<Vec2f>>& candidates = batch.candidates;
+  batch.scores.assign(candidates.size(), -inf);
+  batch.bounds.resize(candidates.size());
+  batch.best = -1;
+
+  Vec2f goal = sim.getGoal().getCenter();
+  for (int i = 0; i < candidates.size(); i++)
+    batch.bounds[i] = scoreEndpoint(candidates[i].back(), goal);
+
+  // the most promising candidates first, so that the incumbent is found early
+  Lane root;
+  root.group.resize(candidates.size());
+  std::iota(root.group.begin(), root.group.end(), 0);
+  if (batch.prune) {
+    std::stable_sort(root.group.begin(), root.group.end(),
+                     [&batch](int a, int b) { return batch.bounds[a] > batch.bounds[b]; });
+  }
+
+  Actor* host = sim.getHost();
+  host->resetPath();
+  host->saveState(root.state);
+  vector<Lane> lanes(1, root);
+  vector<Lane> next;
+  int tick = 0;
+
+  while (lanes.size() != 0) {
+    next.clear();
+
+    for (Lane& lane : lanes) {
+      // the candidates whose end is reached are scored and leave the lane,
+      // those that can not beat the incumbent any more are dropped
+      host->restoreState(lane.state);
+      vector<int> running;
+      for (int c : lane.group) {
+        if (!batch.canBeat(c)) continue;
+        const vector<Vec2f>& path = candidates[c];
+        if (abs(host->getPos().x - path[path.size() - 1].x) > 5) {
+          running.push_back(c);
+          continue;
+        }
+        batch.scores[c] = finishRollout(host, sim, path, batch.occupancy, tick);
+        host->restoreState(lane.state);
+        if (batch.scores[c] > -inf && batch.canBeat(c)) batch.best = c;
+      }
+
+      size_t first = next.size();
+      for (int c : running) {
+        bool found = false;
+        for (size_t i = first; i < next.size(); i++) {
+          if (isSameStep(candidates[next[i].group[0]], candidates[c], lane.state.node_id)) {
+            next[i].group.push_back(c);
+            found = true;
+            break;
+          }
+        }
+        if (!found) {
+          next.push_back(Lane());
+          next.back().group.push_back(c);
+          next.back().state = lane.state;
+        }
+      }
+    }
+
+    // one controller and kinematics step in every lane
+    stepLanes(*host, candidates, next);
+    tick++;
+
+    if (tick > batch.occupancy.horizon()) batch.occupancy.extend(2 * tick);
+    collideLanes(sim, batch.occupancy, tick, next);
+    lanes.swap(next);
+  }
+}
+
+void DecisionMaker::LaneStates::gather(const vector<Lane>& lanes) {
+  size_t num_lanes = lanes.size();
+  pos_x.resize(num_lanes);
+  pos_y.resize(num_lanes);
+  vel_x.resize(num_lanes);
+  vel_y.resize(num_lanes);
+  dir_x.resize(num_lanes);
+  dir_y.resize(num_lanes);
+  wheel_angle.resize(num_lanes);
+  node_id.resize(num_lanes);
+  pre.resize(num_lanes);
+  for (size_t j = 0; j < num_lanes; j++) {
+    const ActorState& state = lanes[j].state;
+    pos_x[j] = state.pos.x;
+    pos_y[j] = state.pos.y;
+    vel_x[j] = state.velocity.x;
+    vel_y[j] = state.velocity.y;
+    dir_x[j] = state.dir.x;
+    dir_y[j] = state.dir.y;
+    wheel_angle[j] = state.wheel_angle;
+    node_id[j] = state.node_id;
+    pre[j] = state.pre;
+  }
+}
+
+void DecisionMaker::LaneStates::scatter(vector<Lane>& lanes) const {
+  for (size_t j = 0; j < lanes.size(); j++) {
+    ActorState& state = lanes[j].state;
+    state.pos = Vec2f(pos_x[j], pos_y[j]);
+    state.velocity = Vec2f(vel_x[j], vel_y[j]);
+    state.dir = Vec2f(dir_x[j], dir_y[j]);
+    state.wheel_angle = wheel_angle[j];
+    state.node_id = node_id[j];
+    state.pre = pre[j];
+  }
+}
+
+/*
+ * the controller of Host::getAutonomousActions, then accelerate,
+ * setWheelAngle and update, each as one pass over the arrays of the lanes.
+ * The arithmetic is the one of Actor and Vector2d, in the same order, so
+ * every lane ends where a host stepped on its own would.
+ */
+void DecisionMaker::stepLanes(const Actor& host, const vector<vector<Vec2f>>& candidates, vector<Lane>& lanes) {
+  LaneStates& s = lane_states;
+  s.gather(lanes);
+  size_t num_lanes = lanes.size();
+
+  // steering towards the next waypoint, on at full throttle
+  for (size_t j = 0; j < num_lanes; j++) {
+    const vector<Vec2f>& path = candidates[lanes[j].group[0]];
+    int size = path.size();
+    Vec2f pos(s.pos_x[j], s.pos_y[j]);
+    if (s.node_id[j] >= size) s.node_id[j] = 0;
+
+    int next_id = s.node_id[j] + 1;
+    if (next_id < size && Vec2f(path[next_id]).get_distance(pos) < Globals::constant.BELIEF_TILE_SIZE * 0.3) {
+      s.pre[j] = s.node_id[j];
+      s.node_id[j] = next_id;
+      next_id = s.node_id[j] + 1;
+    }
+    if (next_id >= size) next_id = s.node_id[j];
+
+    Vec2f vectogoal = path[next_id] - pos;
+    float wheel_angle = -vectogoal.get_angle_between(Vec2f(s.dir_x[j], s.dir_y[j]));
+    int sign = (wheel_angle < 0) ? -1 : 1;
+    wheel_angle = std::min(abs(wheel_angle), host.max_wheel_angle);
+    s.wheel_angle[j] = wheel_angle * sign;
+  }
+
+  // accelerate by the full throttle, then set the wheels
+  float amount = std::min(host.max_wheel_angle * 1.0f, host.max_accler);
+  for (size_t j = 0; j < num_lanes; j++) {
+    if (amount > 0) {
+      Vec2f acceleration(s.dir_x[j], s.dir_y[j]);
+      acceleration.normalized();
+      acceleration *= amount;
+      Vec2f velocity(s.vel_x[j] + acceleration.x, s.vel_y[j] + acceleration.y);
+      if (velocity.Length() >= host.max_speed) {
+        velocity.normalized();
+        velocity *= host.max_speed;
+      }
+      s.vel_x[j] = velocity.x;
+      s.vel_y[j] = velocity.y;
+    }
+    s.wheel_angle[j] = std::max(-host.max_wheel_angle, std::min(s.wheel_angle[j], host.max_wheel_angle));
+  }
+
+  // turn towards the wheels, move, straighten the wheels and apply friction
+  for (size_t j = 0; j < num_lanes; j++) {
+    Vec2f velocity(s.vel_x[j], s.vel_y[j]);
+    if (velocity.Length() > 0.0) {
+      velocity.rotate(s.wheel_angle[j]);
+      Vec2f dir = velocity;
+      dir.normalized();
+      s.dir_x[j] = dir.x;
+      s.dir_y[j] = dir.y;
+    }
+    s.pos_x[j] += velocity.x;
+    s.pos_y[j] += velocity.y;
+    s.wheel_angle[j] = 0;
+
+    if (!(velocity.Length() < host.min_speed)) {
+      Vec2f friction = velocity.get_reflection();
+      friction.normalized();
+      friction *= host.friction;
+      velocity += friction;
+      if (abs(velocity.get_angle_between(friction)) < 180) velocity = Vec2f(0, 0);
+    }
+    s.vel_x[j] = velocity.x;
+    s.vel_y[j] = velocity.y;
+  }
+
+  s.scatter(lanes);
+}
+
+// drop the lanes whose host collides at the tick, the separating axis test
+// only runs for lanes near one of the predicted cars
+void DecisionMaker::collideLanes(const Simulation& sim, const SEARCH::Occupancy& occupancy, int tick,
+                                 vector<Lane>& lanes) {
+  LaneStates& s = lane_states;
+  size_t num_lanes = lanes.size();
+  s.near.assign(num_lanes, 0);
+
+  // broad phase, slightly larger than Actor::collides so it never misses
+  const float reach = Actor::RADIUS * 2 * 1.001;
+  const float reach2 = reach * reach;
+  for (int i = 0; i < occupancy.numCars(); i++) {
+    Vec2f car = occupancy.getPos(tick, i);
+    for (size_t j = 0; j < num_lanes; j++) {
+      float dx = car.x - s.pos_x[j];
+      float dy = car.y - s.pos_y[j];
+      s.near[j] |= (dx * dx + dy * dy <= reach2);
+    }
+  }
+
+  Actor* host = sim.getHost();
+  size_t alive = 0;
+  for (size_t j = 0; j < num_lanes; j++) {
+    host->restoreState(lanes[j].state);
+    vector<Vec2f> bounds = host->getBounds();
+    bool collision = false;
+    for (const Vec2f& point : bounds) {
+      if (!sim.inBounds(point.x, point.y)) {
+        collision = true;
+        break;
+      }
+    }
+    if (!collision && s.near[j])
+      collision = occupancy.collides(host->getPos(), bounds, tick);
+    if (collision) continue;
+    if (alive != j) lanes[alive] = std::move(lanes[j]);
+    alive++;
+  }
+  lanes.resize(alive);
+}
+
 bool DecisionMaker::getPath(const Simulation& simulation, vector<Vec2f>& final_path, vector<int>& car_intentions) {
   // std::string bestAction = "stop";
   // int num_cars = simulation.getAllCars().size();
   vector<string> legal_actions = generateLegalActions(simulation);
-  generatePaths(simulation, legal_actions);
+
+  // the offline policy decides whether to change now, and only the side of
+  // the goal is searched
+  if (policy != nullptr && !policy->empty() && isChangeRequired(simulation)) {
+    MDP::Situation situation = MDP::PolicyTable::observe(simulation, car_intentions);
+    if (policy->lookup(situation) == MDP::WAIT) {
+      paths.clear();
+      final_path.clear();
+      return false;
+    }
+
+    string side = simulation.getGoal().getCenter().y > simulation.getHost()->getPos().y ? "left" : "right";
+    legal_actions.erase(std::remove_if(legal_actions.begin(), legal_actions.end(),
+                                       [&side](const string& action) { return action != side; }),
+                        legal_actions.end());
+  }
+
+  // predict the other cars once, the search avoids their future footprints
+  SEARCH::Occupancy occupancy(simulation, car_intentions, m_prediction_horizon);
+  generatePaths(simulation, legal_actions, &occupancy);
+
+  // no lane change is legal, there is nothing to evaluate
+  if (paths.size() == 0) {
+    final_path.clear();
+    return false;
+  }
+
   int best_index = 0;
   float best_score = -inf;
   float score = 0.0;
 
+  // candidates sharing a prefix are simulated once up to where they split,
+  // and candidates that can not beat the best feasible one are not finished
+  Simulation sim(simulation);
+  RolloutBatch batch(paths, occupancy, true);
+  evaluatePaths(sim, batch);
+
   for (int i = 0; i < paths.size(); i++) {
-    score = evaluatePath(simulation, paths[i], car_intentions);
+    score = batch.scores[i];
     if (score > best_score) {
       best_index = i;
       best_score = score;
@@ -140,27 +454,25 @@ bool DecisionMaker::getPath(const Simulation& simulation, vector<Vec2f>& final_p
 vector<string> DecisionMaker::generateLegalActions(const Simulation& simulation) {
   vector<string> action_list = m_host_actions;
   vector<string> legal_actions;
+  const Actor* host = simulation.getHost();
 
   for (const std::string& action : action_list) {
-    Simulation sim(simulation);
-    Actor* host = sim.getHost();
-
+    float angle = 0;
     if (action == "left") {
-      host->setWheelAngle(45);
+      angle = 45;
     }
     else if (action == "right") {
-      host->setWheelAngle(-45);
+      angle = -45;
     }
 
-    host->setVelocity(sqrt(2) / 2 * float(Globals::constant.BELIEF_TILE_SIZE));
-    host->update();
-
-    vector<Vec2f> bounds = host->getBounds();
+    // the footprint after one step, the host itself is not moved
+    vector<Vec2f> bounds =
+        host->predictBounds(angle, sqrt(2) / 2 * float(Globals::constant.BELIEF_TILE_SIZE));
 
     // check if it is still inbound of the lanes
     bool inBound = true;
     for (const Vec2f& point : bounds) {
-      if (!sim.inBounds(point[0], point[1])) {
+      if (!simulation.inBounds(point[0], point[1])) {
         inBound = false;
         break;
       }
@@ -195,6 +507,37 @@ bool DecisionMaker::isCloseToOtherCar(Actor* host, const Simulation& simulation)
   return false;
 }
 
+bool DecisionMaker::isCloseToOtherCar(Actor* host, const SEARCH::Occupancy& occupancy, int tick) const {
+  if (occupancy.numCars() == 0) return false;
+
+  Vec2f obstacle_pos;
+  float distance = inf;
+
+  for (int i = 0; i < occupancy.numCars(); i++) {
+    Vec2f pos = occupancy.getPos(tick, i);
+    float dist = manhattanDistance(pos, host->getPos());
+    if (dist < distance) {
+      distance = dist;
+      obstacle_pos = pos;
+    }
+  }
+
+  if (abs(obstacle_pos[0] - host->getPos()[0]) < Globals::constant.BELIEF_TILE_SIZE * 1.2 &&
+      abs(obstacle_pos[1] - host->getPos()[1]) < Actor::WIDTH) {
+    return true;
+  }
+  return false;
+}
+
+bool DecisionMaker::checkCollision(Actor* host, const Simulation& simulation, const SEARCH::Occupancy& occupancy,
+                                   int tick) const {
+  vector<Vec2f> bounds = host->getBounds();
+  for (const Vec2f& point : bounds) {
+    if (!simulation.inBounds(point.x, point.y)) return true;
+  }
+  return occupancy.collides(host->getPos(), bounds, tick);
+}
+
 bool DecisionMaker::isChangeRequired(const Simulation& simulation) {
   Actor* host = simulation.getHost();
   Vec2f goal = simulation.getGoal().getCenter();
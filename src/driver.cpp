@@ -0,0 +1,118 @@
+#include "driver.h"
+
+//******************************************************************************
+// Driver member functions
+//******************************************************************************
+
+// without a policy table the candidates are chosen under the joint belief of
+// the inference. The planner stops within a tick of the game, a synchronous
+// driver runs all the iterations so that a replay makes the same choices
+static const int PLANNER_THREADS = 4;
+static const int PLANNER_ITERATIONS = 2000;
+static const unsigned int PLANNER_SEED = 1;
+static const double PLANNER_BUDGET_MS = 40;
+
+// planning runs on its own thread, from snapshots of the simulation. After a
+// failed lane change the two next most likely intentions are planned ahead on
+// another thread while the host observes. A synchronous driver waits for its
+// plans anyway, and does not speculate so that a replay does not depend on
+// the timing of the threads
+Driver::Driver(Simulation& simulation, const MDP::PolicyTable* policy, bool synchronous)
+    : policy(policy),
+      synchronous(synchronous),
+      planner(PLANNER_THREADS, PLANNER_ITERATIONS, PLANNER_SEED, synchronous ? 0 : PLANNER_BUDGET_MS),
+      speculative_planner(PLANNER_THREADS, PLANNER_ITERATIONS, PLANNER_SEED, PLANNER_BUDGET_MS),
+      replanner(planFunction(&decision, &planner), planFunction(&speculative_decision, &speculative_planner),
+                synchronous ? 0 : 2, 3),
+      waiting(false) {
+  decision.setPolicy(policy);
+  speculative_decision.setPolicy(policy);
+
+  // each neighboring cars' yielding intention
+  car_intentions.assign(simulation.getOtherCars().size(), 1);
+
+  // the first plan is waited for and followed even without a lane change
+  replanner.request(simulation, car_intentions, simulation.getInference().getBelief(), 0);
+  replanner.wait(plan, 0);
+  final_path = plan.path;
+  candidate_paths = plan.candidates;
+
+  // replans are only asked for when the followed plan stops holding
+  trigger.reset(simulation, plan.car_intentions, 0);
+}
+
+Replanner::PlanFunction Driver::planFunction(DecisionMaker* maker, BANDIT::Planner* searcher) {
+  return [this, maker, searcher](Replanner::Snapshot& snapshot, Replanner::Plan& plan) {
+    const Simulation& sim = *snapshot.simulation;
+    if (policy != nullptr)
+      plan.success = maker->getPath(sim, plan.path, snapshot.car_intentions);
+    else
+      plan.success = searcher->getPath(sim, *maker, plan.path, snapshot.car_intentions, snapshot.belief);
+    plan.change = maker->isChangeRequired(sim);
+    plan.candidates = maker->getPaths();
+  };
+}
+
+void Driver::observe(Simulation& simulation) {
+  Host* host = dynamic_cast<Host*>(simulation.getHost());
+  host->makeObservation(simulation);
+  vector<Actor*> cars = simulation.getOtherCars();
+  for (Actor* actor : cars) {
+    Car* car = dynamic_cast<Car*>(actor);
+    car->getInference(simulation.getIndex(car) + 1, simulation)->observe(simulation);
+  }
+
+  // the beliefs are read once every car has observed the tick
+  car_intentions.clear();
+  for (Actor* actor : cars) {
+    Car* car = dynamic_cast<Car*>(actor);
+    vector<float> belief = car->getInference(simulation.getIndex(car) + 1, simulation)->getBelief();
+    int max_index = 0;
+    for (int j = 0; j < belief.size(); j++) {
+      if (belief[j] > belief[max_index]) max_index = j;
+    }
+    car_intentions.push_back(max_index);
+  }
+}
+
+void Driver::take(Simulation& simulation, int tick) {
+  trigger.reset(simulation, plan.car_intentions, tick);
+  candidate_paths = plan.candidates;
+  waiting = !plan.success && plan.change;
+  if (waiting) final_path.clear();
+  else final_path = plan.path;
+  simulation.getHost()->resetPath();
+}
+
+void Driver::step(Simulation& simulation, int tick) {
+  Actor* host = simulation.getHost();
+
+  // observe the other cars every tick, a plan made for other intentions than
+  // the most likely ones no longer holds
+  observe(simulation);
+
+  // follow the newest plan, after a failed lane change the host slows down and
+  // observes until the next plan comes
+  if (replanner.poll(plan, tick)) take(simulation, tick);
+
+  // ask for new paths when the followed plan no longer holds, unless they are
+  // coming already
+  ReplanTrigger::Event event = trigger.check(simulation, final_path, car_intentions, waiting, tick);
+  if (event != ReplanTrigger::NONE && !replanner.pending()) {
+    replanner.request(simulation, car_intentions, simulation.getInference().getBelief(), tick);
+    if (synchronous) {
+      replanner.wait(plan, tick);
+      take(simulation, tick);
+    }
+  }
+
+  // the path has run out and the next one is still being planned, or the host
+  // has already passed the end of a plan made from an older snapshot
+  bool path_over = final_path.size() == 0 || abs(host->getPos().x - final_path[final_path.size() - 1].x) < 10;
+  bool passed = final_path.size() != 0 && host->getPos().x > final_path[final_path.size() - 1].x;
+  bool starved = (path_over && replanner.pending()) || passed;
+
+  if (waiting || starved) decision.applyAction(simulation, 0, "dec");
+  else host->autonomousAction(final_path, simulation, nullptr);
+  host->update();
+}
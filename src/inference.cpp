@@ -1,40 +1,160 @@
 #include "inference.h"
 
+#include <atomic>
+#include <functional>
+
 namespace Inference {
 
 //******************************************************************************
 // Helper functions
 //******************************************************************************
 
-// to produce the permutation of a list of states
-vector<vector<string>> product(const vector<string>& states, int repeat = 2) {
-  vector<vector<string>> res(states.size());
-  vector<vector<string>> output;
-  for (int i = 0; i < states.size(); i++) res[i].push_back(states[i]);
+// to produce the log of the pdf
+double logPdf(float mean, float std, float value) {
+  double u = double(value - mean) / abs(std);
+  return -u * u / 2.0 - log(sqrt(2 * PI) * abs(std));
+}
+
+// the speed of a car with the intention is normal around its mean, and never
+// narrower than the spread of the speeds the car has shown
+pff getMeanStandard(float reference, const string& intention, float spread) {
+  float v_ref = int(reference);
+
+  if (v_ref == 0) v_ref = 0.01;
+
+  float sigma = std::max(0.3f * v_ref, spread);
+  int index = g_intention2index.at(intention);
+
+  // decel, normal, accel
+  if (index == 0) {
+    return pff(0.7 * v_ref, sigma);
+  }
+  else if (index == 1) {
+    return pff(v_ref, sigma);
+  }
+
+  return pff(0, 0);
+}
 
-  if (repeat == 1) {
-    return res;
+// the likelihood of the last observation only depends on the intention of
+// each car, so there are only as many values per car as intentions, intention
+// k of car c at c * intentions.size() + k
+static void computeLogLikelihoods(const Simulation& simulation, const vector<string>& intentions,
+                                  vector<double>& log_likelihoods) {
+  const ObservationTable& observations = simulation.getObservations();
+  int num_cars = simulation.getOtherCars().size();
+  int radix = intentions.size();
+  log_likelihoods.resize(num_cars * radix);
+  for (int index = 0; index < num_cars; index++) {
+    float reference = observations.getReference(index);
+    float observ = observations.getLast(index);
+    float spread = sqrt(observations.getVariance(index));
+    for (int k = 0; k < radix; k++) {
+      pff res = getMeanStandard(reference, intentions[k], spread);
+      log_likelihoods[index * radix + k] = logPdf(res.first, res.second, observ);
+    }
   }
+}
 
-  vector<vector<string>> middle = product(states, repeat - 1);
+// the product of the beliefs of cars that are independent, intention k of car
+// c at c * radix + k. visit(digits, p) is called for every joint state when
+// there are at most max_states of them, and else for as many samples of it,
+// the same ones for a stream
+template <class T>
+static void visitProduct(const vector<T>& beliefs, int num_cars, int radix, int max_states, unsigned int stream,
+                         const std::function<void(const vector<int>&, double)>& visit) {
+  double num_states = 1;
+  for (int i = 0; i < num_cars && num_states <= max_states; i++) num_states *= radix;
+
+  vector<int> digits(num_cars, 0);
+  if (num_states <= max_states) {
+    // every joint state in the order of a counter over the cars
+    for (int state = 0; state < num_states; state++) {
+      double p = 1;
+      for (int index = 0; index < num_cars; index++) p *= beliefs[index * radix + digits[index]];
+      if (p > 0) visit(digits, p);
+      for (int index = 0; index < num_cars && ++digits[index] == radix; index++) digits[index] = 0;
+    }
+    return;
+  }
 
-  for (int i = 0; i < res.size(); i++) {
-    for (int j = 0; j < middle.size(); j++) {
-      vector<string> temp(res[i]);
-      temp.insert(temp.end(), middle[j].begin(), middle[j].end());
-      output.push_back(temp);
+  std::mt19937 g(stream);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  for (int i = 0; i < max_states; i++) {
+    for (int index = 0; index < num_cars; index++) {
+      double u = uniform(g);
+      int k = 0;
+      for (double cumulative = beliefs[index * radix]; u > cumulative && k < radix - 1;)
+        cumulative += beliefs[index * radix + ++k];
+      digits[index] = k;
     }
+    visit(digits, 1.0 / max_states);
   }
+}
+
+// the particles are split in blocks of a fixed size whatever the number of
+// threads, and the sums of the blocks are added in order, so the result does
+// not depend on the threads
+static const int BLOCK_SIZE = 1 << 14;
+
+//******************************************************************************
+// WorkerPool member functions
+//******************************************************************************
 
-  return output;
+WorkerPool::WorkerPool(int threads)
+    : task(nullptr), num_tasks(0), next(0), busy(0), generation(0), stopping(false) {
+  for (int i = 1; i < threads; i++) workers.push_back(std::thread(&WorkerPool::work, this));
 }
 
-// to produce pdf
-double pdf(float mean, float std, float value) {
-  double u = double(value - mean) / abs(std);
-  double y = (1.0 / (sqrt(2 * PI) * abs(std))) * exp(-u * u / 2.0);
-  if (y == 0) return 0.00000001;
-  return y;
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto& worker : workers) worker.join();
+}
+
+void WorkerPool::run(int num_tasks, const std::function<void(int)>& task) {
+  if (workers.empty() || num_tasks <= 1) {
+    for (int i = 0; i < num_tasks; i++) task(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->task = &task;
+    this->num_tasks = num_tasks;
+    next.store(0);
+    busy = workers.size();
+    generation++;
+  }
+  wake.notify_all();
+  claim();
+
+  // every worker leaves the run before the next one starts
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this]() { return busy == 0; });
+  this->task = nullptr;
+}
+
+void WorkerPool::work() {
+  unsigned int seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping) return;
+      seen = generation;
+    }
+    claim();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--busy == 0) done.notify_one();
+  }
+}
+
+void WorkerPool::claim() {
+  for (int i = next++; i < num_tasks; i = next++) (*task)(i);
 }
 
 //******************************************************************************
@@ -46,18 +166,67 @@ void JointParticles::initializeUniformly(const Simulation& simulation,
   // stores infomraiton about the simulation, then initialize the particles
   num_cars = simulation.getOtherCars().size();
   legal_intentions = intentions;
-  beliefs = Counter<vector<string>>();
+  radix = intentions.size();
+
+  // the joint states are filtered when they fit in a JointState, the cars
+  // are filtered on their own otherwise
+  place.assign(1, 1);
+  num_states = 0;
+  for (int i = 0; i < num_cars; i++) {
+    if (place.back() > std::numeric_limits<JointState>::max() / radix) break;
+    place.push_back(place.back() * radix);
+  }
+  if (place.size() == num_cars + 1) num_states = place.back();
+  place.pop_back();
+  if (num_states == 0) factored = true;
+
+  beliefs = Counter<JointState>();
+  num_observations = 0;
   initializeParticles();
+  updateMarginals();
+}
+
+// the random numbers of a task, the same for a seed at every observation
+// a small observation runs on the caller, the pool is made by the first one
+// spread over threads
+void JointParticles::parallelFor(int num_tasks, int threads, const std::function<void(int)>& task) {
+  if (num_tasks <= 1 || threads <= 1) {
+    for (int i = 0; i < num_tasks; i++) task(i);
+    return;
+  }
+  if (!pool) pool.reset(new WorkerPool(num_threads));
+  pool->run(num_tasks, task);
+}
+
+std::mt19937 JointParticles::getStream(unsigned int id) const {
+  std::seed_seq seq{seed, num_observations, id};
+  return std::mt19937(seq);
 }
 
 void JointParticles::initializeParticles() {
-  std::random_device rd;
-  std::mt19937 g(rd());
-  vector<vector<string>> joint_states = product(legal_intentions, num_cars);
+  if (factored) {
+    initializeFactored();
+    return;
+  }
+
+  std::mt19937 g = getStream(INITIAL_STREAM);
+  particles.clear();
+  particles.reserve(num_particles);
+
+  // with more joint states than particles, each particle is a random state
+  if (num_states > num_particles) {
+    std::uniform_int_distribution<JointState> uniform(0, num_states - 1);
+    for (int i = 0; i < num_particles; i++) particles.push_back(uniform(g));
+    weights.assign(particles.size(), 1.0 / particles.size());
+    log_weights.assign(particles.size(), -log(particles.size()));
+    return;
+  }
+
+  vector<JointState> joint_states(num_states);
+  std::iota(joint_states.begin(), joint_states.end(), 0);
   std::shuffle(joint_states.begin(), joint_states.end(), g);
   int n = num_particles;
   int p = joint_states.size();
-  particles.clear();
 
   // n = k*p + b
   // each particle represents a permutation/state, like ["cooperative", "aggressive", ...]
@@ -69,163 +238,455 @@ void JointParticles::initializeParticles() {
 
   particles.insert(particles.end(), joint_states.begin(),
                    joint_states.begin() + n);
+  weights.assign(particles.size(), 1.0 / particles.size());
+  log_weights.assign(particles.size(), -log(particles.size()));
+}
+
+// every intention is taken by the same share of the particles of a car,
+// shuffled on their own so that the cars are independent
+void JointParticles::initializeFactored() {
+  particles.clear();
+  car_particles.resize(num_cars * num_particles);
+  car_log_weights.assign(num_cars * radix, 0);
+
+  for (int index = 0; index < num_cars; index++) {
+    std::mt19937 g = getStream(CAR_STREAM + index);
+    unsigned char* intentions = &car_particles[index * num_particles];
+    for (int i = 0; i < num_particles; i++) intentions[i] = i % radix;
+    std::shuffle(intentions, intentions + num_particles, g);
+  }
 }
 
 void JointParticles::observe(const Simulation& simulation) {
+  if (factored)
+    observeFactored(simulation);
+  else
+    observeJoint(simulation);
+  updateMarginals();
+  num_observations++;
+}
+
+void JointParticles::observeJoint(const Simulation& simulation) {
   if (beliefs.size() == 1) initializeParticles(); // ?
 
-  vector<Actor*> cars = simulation.getOtherCars();
-  Counter<vector<string>> tempCounter = Counter<vector<string>>();
+  computeLogLikelihoods(simulation, legal_intentions, log_likelihoods);
+
+  int n = particles.size();
+  int num_blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  vector<double> block_largest(num_blocks, -inf);
+  vector<double> block_totals(num_blocks, 0);
+  vector<double> block_squares(num_blocks, 0);
+  vector<Counter<JointState>> block_beliefs(num_blocks);
 
-  for (int i = 0; i < particles.size(); i++) {
-    float prob = 1;
-    vector<string> intentions = particles[i];
-    // intention of each car is independent event for each other
+  // a particle adds up the entries of its intentions, car by car so that the
+  // inner loop runs over the particles of the block
+  parallelFor(num_blocks, num_threads, [&](int b) {
+    int begin = b * BLOCK_SIZE;
+    int end = std::min(n, begin + BLOCK_SIZE);
     for (int index = 0; index < num_cars; index++) {
-      queue<float> history = ((Car*)cars[index])->getHistory();
-      float observ = history.back();
-      string intention = intentions[index];
-      pff res = getMeanStandard(history, intention);
-      prob *= pdf(res.first, res.second, observ);
+      const double* row = &log_likelihoods[index * radix];
+      if (radix == 2) {
+        double base = row[0];
+        double diff = row[1] - row[0];
+        for (int i = begin; i < end; i++) log_weights[i] += base + diff * ((particles[i] >> index) & 1);
+      } else {
+        for (int i = begin; i < end; i++) log_weights[i] += row[getIntention(particles[i], index)];
+      }
     }
-    tempCounter[intentions] += prob;
+    block_largest[b] = *std::max_element(log_weights.begin() + begin, log_weights.begin() + end);
+  });
+
+  // normalized in the log domain, so that the weights cannot underflow
+  double largest = *std::max_element(block_largest.begin(), block_largest.end());
+  if (!std::isfinite(largest)) {
+    initializeParticles();
+    return;
   }
 
-  beliefs = tempCounter;
-  cout << "-----------------------------------------------------------" << endl;
-  cout << "[Simulation]: " << endl;
-  for (const auto& item : beliefs) {
-    cout << "\tBelief: ";
-    for (int i = 0; i < item.first.size(); i++) {
-      cout << "\t" << item.first[i] << " ";
+  parallelFor(num_blocks, num_threads, [&](int b) {
+    int end = std::min(n, (b + 1) * BLOCK_SIZE);
+    for (int i = b * BLOCK_SIZE; i < end; i++) {
+      weights[i] = exp(log_weights[i] - largest);
+      block_totals[b] += weights[i];
     }
-    cout << "\t" << item.second << endl;
+  });
+
+  double total = 0;
+  for (double block_total : block_totals) total += block_total;
+  double log_total = largest + log(total);
+
+  parallelFor(num_blocks, num_threads, [&](int b) {
+    int end = std::min(n, (b + 1) * BLOCK_SIZE);
+    for (int i = b * BLOCK_SIZE; i < end; i++) {
+      log_weights[i] -= log_total;
+      weights[i] /= total;
+      block_squares[b] += weights[i] * weights[i];
+      block_beliefs[b][particles[i]] += weights[i];
+    }
+    block_totals[b] /= total;
+  });
+
+  double squares = 0;
+  beliefs = Counter<JointState>();
+  for (int b = 0; b < num_blocks; b++) {
+    squares += block_squares[b];
+    for (const auto& item : block_beliefs[b]) beliefs[item.first] += item.second;
   }
 
-  cout << "[Simulation]: Now it has finished!" << endl;
+  // resampling, only once the weights have drifted too far apart
+  if (1 / squares < resample_threshold * n) resample(block_totals);
+}
 
-  // resampling
-  if (tempCounter.size() == 0) {
-    initializeParticles();
-  }
-  else {
-    beliefs.normalize();
-    for (int i = 0; i < particles.size(); i++) {
-      vector<string> new_state = sample(beliefs);
-      particles[i] = new_state;
+// low variance resampling, the particles are picked at evenly spaced points
+// of the cumulative weights from a single random offset. Each block picks
+// the points that fall within its weights, from the prefix sum of the blocks
+void JointParticles::resample(const vector<double>& block_totals) {
+  int n = particles.size();
+  int num_blocks = block_totals.size();
+  double step = 1.0 / n;
+  std::mt19937 g = getStream(RESAMPLE_STREAM);
+  double offset = std::uniform_real_distribution<double>(0, step)(g);
+
+  vector<double> prefix(num_blocks + 1, 0);
+  for (int b = 0; b < num_blocks; b++) prefix[b + 1] = prefix[b] + block_totals[b];
+
+  // the first point past a cumulative weight
+  auto firstPoint = [&](double cumulative) {
+    if (cumulative < offset) return 0;
+    return std::min(n, int(floor((cumulative - offset) / step)) + 1);
+  };
+
+  resampled.resize(n);
+  parallelFor(num_blocks, num_threads, [&](int b) {
+    int begin = b * BLOCK_SIZE;
+    int end = std::min(n, begin + BLOCK_SIZE);
+    int first = b == 0 ? 0 : firstPoint(prefix[b]);
+    int last = b == num_blocks - 1 ? n : firstPoint(prefix[b + 1]);
+    double cumulative = prefix[b] + weights[begin];
+    int i = begin;
+    for (int j = first; j < last; j++) {
+      double point = offset + j * step;
+      while (point > cumulative && i < end - 1) cumulative += weights[++i];
+      resampled[j] = particles[i];
     }
-  }
+  });
+
+  particles.swap(resampled);
+  weights.assign(n, step);
+  log_weights.assign(n, -log(n));
+  resamples++;
+}
+
+// the weight of a particle of a car only depends on its intention, so a car
+// keeps one weight per intention and is resampled from the counts
+void JointParticles::observeFactored(const Simulation& simulation) {
+  computeLogLikelihoods(simulation, legal_intentions, log_likelihoods);
+
+  // the cars are filtered on their own, each from its own random numbers
+  vector<double> masses(num_cars * radix);
+  vector<char> resampled_cars(num_cars, 0);
+  parallelFor(num_cars, num_particles * num_cars < BLOCK_SIZE ? 1 : num_threads, [&](int index) {
+    unsigned char* intentions = &car_particles[index * num_particles];
+    double* log_weight = &car_log_weights[index * radix];
+    double* mass = &masses[index * radix];
+    std::mt19937 g = getStream(CAR_STREAM + index);
+
+    vector<int> counts(radix, 0);
+    for (int i = 0; i < num_particles; i++) counts[intentions[i]]++;
+
+    // the weights are kept relative to the largest, so that their products
+    // over many cars do not underflow
+    double largest = -inf;
+    for (int k = 0; k < radix; k++) {
+      log_weight[k] += log_likelihoods[index * radix + k];
+      if (counts[k] > 0) largest = std::max(largest, log_weight[k]);
+    }
+    if (!std::isfinite(largest)) {
+      for (int i = 0; i < num_particles; i++) intentions[i] = g() % radix;
+      std::fill(log_weight, log_weight + radix, 0);
+      return;
+    }
+
+    double total = 0;
+    for (int k = 0; k < radix; k++) {
+      log_weight[k] -= largest;
+      mass[k] = counts[k] * exp(log_weight[k]);
+      total += mass[k];
+    }
+
+    double squares = 0;
+    for (int k = 0; k < radix; k++) {
+      mass[k] /= total;
+      if (counts[k] > 0) squares += mass[k] * mass[k] / counts[k];
+    }
+    if (1 / squares >= resample_threshold * num_particles) return;
+
+    // low variance resampling of the counts, then the particles are shuffled
+    // so that the cars stay independent when they are joined
+    double step = 1.0 / num_particles;
+    double point = std::uniform_real_distribution<double>(0, step)(g);
+    double cumulative = mass[0];
+    int k = 0;
+    for (int i = 0; i < num_particles; i++, point += step) {
+      while (point > cumulative && k < radix - 1) cumulative += mass[++k];
+      intentions[i] = k;
+    }
+    std::shuffle(intentions, intentions + num_particles, g);
+    std::fill(log_weight, log_weight + radix, 0);
+    resampled_cars[index] = 1;
+  });
+
+  for (int index = 0; index < num_cars; index++) resamples += resampled_cars[index];
 }
 
 Counter<vector<string>> JointParticles::getBelief() {
   Counter<vector<string>> beliefDist = Counter<vector<string>>();
 
-  for (int index = 0; index < particles.size(); index++) {
-    beliefDist[particles[index]] += 1;
+  if (factored) {
+    vector<string> intentions(num_cars);
+    visitProduct(marginals, num_cars, radix, MAX_JOINT, num_observations, [&](const vector<int>& digits, double p) {
+      for (int index = 0; index < num_cars; index++) intentions[index] = legal_intentions[digits[index]];
+      beliefDist[intentions] += p;
+    });
+    return beliefDist;
   }
 
-  beliefDist.normalize();
+  for (const auto& item : getStateBelief()) {
+    beliefDist[decode(item.first)] = item.second;
+  }
 
   return beliefDist;
 }
 
-// "randonly" pick a particle/state from the distribution
-// distribution: A distribution of particles.
-vector<string> JointParticles::sample(Counter<vector<string>>& distribution) {
-  if (distribution.sum() != 1) distribution.normalize();
+Counter<JointState> JointParticles::getStateBelief() const {
+  Counter<JointState> beliefDist = Counter<JointState>();
+
+  if (factored) {
+    if (num_states == 0) return beliefDist;
+    visitProduct(marginals, num_cars, radix, MAX_JOINT, num_observations, [&](const vector<int>& digits, double p) {
+      JointState state = 0;
+      for (int index = 0; index < num_cars; index++) state += place[index] * digits[index];
+      beliefDist[state] += p;
+    });
+    return beliefDist;
+  }
 
-  std::vector<std::pair<vector<string>, float>> elems(distribution.begin(),
-                                                      distribution.end());
+  for (int i = 0; i < particles.size(); i++) beliefDist[particles[i]] += weights[i];
+  beliefDist.normalize();
 
-  // sort the particle/state based on the probability in incresing order
-  std::sort(elems.begin(), elems.end(),
-            [](const std::pair<vector<string>, float>& a,
-               const std::pair<vector<string>, float>& b) -> bool {
-              return a.second < b.second;
-            });
+  return beliefDist;
+}
 
-  vector<vector<string>> keys; // particles/states
-  vector<float> values; // probabilities
+vector<float> JointParticles::getMarginal(int car) const {
+  return vector<float>(marginals.begin() + car * radix, marginals.begin() + (car + 1) * radix);
+}
 
-  for (auto item : elems) {
-    keys.push_back(item.first);
-    values.push_back(item.second);
+// all the marginals in one pass over the particles, by blocks like observe
+void JointParticles::updateMarginals() {
+  marginals.assign(num_cars * radix, 0);
+
+  if (factored) {
+    parallelFor(num_cars, num_particles * num_cars < BLOCK_SIZE ? 1 : num_threads, [&](int car) {
+      const unsigned char* intentions = &car_particles[car * num_particles];
+      vector<int> counts(radix, 0);
+      for (int i = 0; i < num_particles; i++) counts[intentions[i]]++;
+
+      double total = 0;
+      for (int k = 0; k < radix; k++) total += counts[k] * exp(car_log_weights[car * radix + k]);
+      for (int k = 0; k < radix; k++)
+        marginals[car * radix + k] = counts[k] * exp(car_log_weights[car * radix + k]) / total;
+    });
+    return;
   }
 
-  double choice = ((double)rand() / (RAND_MAX));
-  int i = 0;
-  double total = values[0];
+  int n = particles.size();
+  if (n == 0) return;
+  int num_blocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  vector<vector<double>> block_sums(num_blocks, vector<double>(num_cars * radix, 0));
+  vector<double> block_totals(num_blocks, 0);
+
+  parallelFor(num_blocks, num_threads, [&](int b) {
+    vector<double>& sums = block_sums[b];
+    int end = std::min(n, (b + 1) * BLOCK_SIZE);
+    for (int i = b * BLOCK_SIZE; i < end; i++) {
+      block_totals[b] += weights[i];
+      // with one bit per car only the set bits are visited, they are the
+      // aggressive cars
+      if (radix == 2) {
+        for (JointState state = particles[i]; state != 0; state &= state - 1)
+          sums[__builtin_ctzll(state) * 2 + 1] += weights[i];
+      } else {
+        for (int car = 0; car < num_cars; car++) sums[car * radix + getIntention(particles[i], car)] += weights[i];
+      }
+    }
+  });
 
-  while (choice > total) {
-    i += 1;
-    total += values[i];
+  vector<double> sums(num_cars * radix, 0);
+  double total = 0;
+  for (int b = 0; b < num_blocks; b++) {
+    total += block_totals[b];
+    for (int j = 0; j < sums.size(); j++) sums[j] += block_sums[b][j];
+  }
+
+  for (int car = 0; car < num_cars; car++) {
+    if (radix == 2) sums[car * 2] = total - sums[car * 2 + 1];
+    for (int k = 0; k < radix; k++) marginals[car * radix + k] = sums[car * radix + k] / total;
   }
-  return keys[i > keys.size() - 1 ? keys.size() - 1 : i];
 }
 
-pff JointParticles::getMeanStandard(queue<float>& history, const string& intention) {
-  int total = history.front();
-  // for (int i = 0; i < history.size(); i++) {
-  //   total += history[i];
-  // }
-  float v_ref = total;
+vector<string> JointParticles::decode(JointState state) const {
+  vector<string> intentions(num_cars);
+  for (int i = 0; i < num_cars; i++) intentions[i] = legal_intentions[getIntention(state, i)];
+  return intentions;
+}
 
-  if (v_ref == 0) v_ref = 0.01;
+//******************************************************************************
+// ForwardFilter member functions
+//******************************************************************************
 
-  float sigma = 0.3 * v_ref; // How to get this value?
-  int index = g_intention2index.at(intention);
+void ForwardFilter::setTransitions(const vector<vector<float>>& matrix) {
+  radix = matrix.size();
+  transitions.assign(radix * radix, 0);
+  for (int i = 0; i < radix; i++) {
+    assert(matrix[i].size() == radix);
+    for (int j = 0; j < radix; j++) transitions[i * radix + j] = matrix[i][j];
+  }
+}
 
-  // decel, normal, accel
-  if (index == 0) {
-    return pff(0.7 * v_ref, sigma);
+void ForwardFilter::initializeUniformly(const Simulation& simulation, const vector<string>& intentions) {
+  num_cars = simulation.getOtherCars().size();
+  legal_intentions = intentions;
+
+  // a matrix of its own is kept while it fits the intentions
+  if (transitions.size() != intentions.size() * intentions.size()) {
+    transitions.clear();
+    if (switch_probability > 0 && intentions.size() > 1) {
+      vector<vector<float>> matrix(intentions.size(), vector<float>(intentions.size(),
+                                                                     switch_probability / (intentions.size() - 1)));
+      for (int i = 0; i < intentions.size(); i++) matrix[i][i] = 1 - switch_probability;
+      setTransitions(matrix);
+    }
   }
-  else if (index == 1) {
-    return pff(v_ref, sigma);
+  radix = intentions.size();
+
+  beliefs.assign(num_cars * radix, 1.0 / radix);
+  num_observations = 0;
+}
+
+// predict by the transitions, then weight by the likelihoods relative to the
+// largest so that they do not underflow
+void ForwardFilter::observe(const Simulation& simulation) {
+  computeLogLikelihoods(simulation, legal_intentions, log_likelihoods);
+
+  vector<double> predicted(radix);
+  for (int index = 0; index < num_cars; index++) {
+    double* belief = &beliefs[index * radix];
+    const double* log_likelihood = &log_likelihoods[index * radix];
+
+    if (transitions.empty()) {
+      std::copy(belief, belief + radix, predicted.begin());
+    } else {
+      std::fill(predicted.begin(), predicted.end(), 0);
+      for (int i = 0; i < radix; i++)
+        for (int j = 0; j < radix; j++) predicted[j] += belief[i] * transitions[i * radix + j];
+    }
+
+    double largest = *std::max_element(log_likelihood, log_likelihood + radix);
+    double total = 0;
+    for (int k = 0; k < radix; k++) {
+      belief[k] = predicted[k] * exp(log_likelihood[k] - largest);
+      total += belief[k];
+    }
+
+    // the observation is impossible under the belief, it starts over
+    if (!(total > 0)) {
+      std::fill(belief, belief + radix, 1.0 / radix);
+      continue;
+    }
+    for (int k = 0; k < radix; k++) belief[k] /= total;
   }
-  // else if (index == 2) {
-  //   return pff(1.5*v_ref,sigma);
-  // }
+  num_observations++;
+}
 
-  return pff(0, 0);
+vector<float> ForwardFilter::getMarginal(int car) const {
+  return vector<float>(beliefs.begin() + car * radix, beliefs.begin() + (car + 1) * radix);
+}
+
+Counter<vector<string>> ForwardFilter::getBelief() const {
+  Counter<vector<string>> beliefDist = Counter<vector<string>>();
+  vector<string> intentions(num_cars);
+
+  // the same samples for the same observations
+  visitProduct(beliefs, num_cars, radix, MAX_JOINT, num_observations, [&](const vector<int>& digits, double p) {
+    for (int index = 0; index < num_cars; index++) intentions[index] = legal_intentions[digits[index]];
+    beliefDist[intentions] += p;
+  });
+  return beliefDist;
 }
 
 //******************************************************************************
 // MarginalInference member functions (declared in simulation.h)
 //******************************************************************************
 
-MarginalInference::MarginalInference(int index, const Simulation& simulation) {
+MarginalInference::MarginalInference(int index, Context& context) {
   this->index = index;
+  this->context = &context;
   legal_intentions = g_intentions;
-  initializeUniformly(simulation);
 }
 
-void MarginalInference::initializeUniformly(const Simulation& simulation) {
-  if (index == 1)
-    jointInference.initializeUniformly(simulation, legal_intentions);
+void MarginalInference::observe(const Simulation& simulation) { context->observe(simulation); }
+
+std::vector<float> MarginalInference::getBelief() {
+  vector<float> result = context->getCarBelief(index - 1);
+  result.resize(legal_intentions.size());
+  return result;
 }
 
-void MarginalInference::observe(const Simulation& simulation) {
-  if (index == 1) jointInference.observe(simulation);
+//******************************************************************************
+// Context member functions
+//******************************************************************************
+
+Context::Context(const Simulation& simulation, Engine engine) : observed(0) {
+  if (engine == PARTICLES) joint.reset(new JointParticles());
+  else exact.reset(new ForwardFilter());
+  initialize(simulation);
 }
 
-std::vector<float> MarginalInference::getBelief() {
-  Counter<vector<string>> jointDistribution = jointInference.getBelief();
-  Counter<int> dist = Counter<int>();
+Context::Context(const Simulation& simulation, ForwardFilter* exact)
+    : exact(exact), observed(0) {
+  initialize(simulation);
+}
 
-  for (const auto& item : jointDistribution) {
-    int i = g_intention2index.at(item.first[index - 1]);
-    dist[i] += item.second;
-  }
+Context::Context(const Simulation& simulation, JointParticles* joint)
+    : joint(joint), observed(0) {
+  initialize(simulation);
+}
 
-  vector<float> result = vector<float>();
+void Context::initialize(const Simulation& simulation) {
+  if (joint) joint->initializeUniformly(simulation, g_intentions);
+  else exact->initializeUniformly(simulation, g_intentions);
+}
 
-  result.resize(legal_intentions.size());
+Context::~Context() {}
 
-  for (const auto& item : dist) result[item.first] = item.second;
-  // if (result[0] > result[1]) {
-  //   cout << "I am here" << endl;
-  // }
-  return result;
+void Context::observe(const Simulation& simulation) {
+  unsigned int version = simulation.getObservations().getVersion();
+  if (version == observed) return;
+  if (joint) joint->observe(simulation);
+  else exact->observe(simulation);
+  observed = version;
+}
+
+MarginalInference* Context::getMarginal(int index) {
+  if (marginals.size() < index) marginals.resize(index);
+  if (!marginals[index - 1]) marginals[index - 1].reset(new MarginalInference(index, *this));
+  return marginals[index - 1].get();
+}
+
+vector<float> Context::getCarBelief(int car) const {
+  return joint ? joint->getMarginal(car) : exact->getMarginal(car);
 }
 
+Counter<vector<string>> Context::getBelief() { return joint ? joint->getBelief() : exact->getBelief(); }
+
 }
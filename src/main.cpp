@@ -14,9 +14,8 @@
 #include <iomanip>
 #include <iostream>
 
-#include "decision_making.h"
+#include "driver.h"
 #include "display.h"
-#include "inference.h"
 #include "util.h"
 
 using namespace std;
@@ -57,26 +56,17 @@ int main(void) {
   // bool gameover = false;
   bool over = false;
 
-  // decision making module
-  DecisionMaker decision;
-
-  // final path
-  vector<Vec2f> final_path;
-
-  // each neighboring cars' yielding intention
-  vector<int> car_intentions;
-  for (int i = 0; i < simulation.getOtherCars().size(); i++) {
-    car_intentions.push_back(1);
+  // lane change policy solved offline by policy_solver, without it every
+  // change is decided by the planner
+  MDP::PolicyTable policy;
+  if (policy.load("../data/policy.bin")) {
+    std::cout << "[Policy]: loaded ../data/policy.bin" << std::endl;
   }
 
-  bool success = decision.getPath(simulation, final_path, car_intentions);
-
-  // get candidate paths
-  vector<vector<Vec2f>> candidate_paths = decision.getPaths();
-
-  // the change for car is mandatory
-  bool change = true;
+  // observes, replans and moves the host
+  Driver driver(simulation, policy.empty() ? nullptr : &policy);
 
+  int tick = 0;
   while (!glfwWindowShouldClose(window)) {
     //**************************************************************************
     // Display static taffic objects.
@@ -90,7 +80,7 @@ int main(void) {
     //**************************************************************************
     // Draw candidate paths.
     //**************************************************************************
-    for (auto p : candidate_paths) {
+    for (auto p : driver.getCandidates()) {
       drawPolygon(p);
     }
 
@@ -107,33 +97,21 @@ int main(void) {
       for (Actor* car : cars) {
         // my car moves
         if (car == host) {
-          // destination reaches, generate new paths
-          if (final_path.size() == 0 || abs(host->getPos().x - final_path[final_path.size() - 1].x) < 10) {
-            success = decision.getPath(simulation, final_path, car_intentions);
-            change = decision.isChangeRequired(simulation);
-            // candidate paths
-            candidate_paths = decision.getPaths();
-            if (!success && change) {
-              car_intentions = infer(simulation);
-              final_path.clear();
-              decision.applyAction(simulation, 0, "dec");
-              car->update();
-            } else {
-              car->autonomousAction(final_path, simulation, nullptr);
-              car->update();
-            }
-          }
-          // using the current path
-          else {
-            car->autonomousAction(final_path, simulation, nullptr);
-            car->update();
+          driver.step(simulation, tick);
+
+          vector<string> colors{"orange", "red"};
+          vector<Actor*> others = simulation.getOtherCars();
+          for (int i = 0; i < others.size(); i++) {
+            display.colorChange(others[i], colors[driver.getIntentions()[i]]);
           }
+
           // display the final path
+          vector<Vector2f> final_path = driver.getPath();
           drawPolygon(final_path);
         }
         // other car moves
         else {
-          car->autonomousAction(final_path, simulation, nullptr);
+          car->autonomousAction(driver.getPath(), simulation, nullptr);
           car->update();
         }
       }
@@ -151,7 +129,22 @@ int main(void) {
     over = (gameover(simulation) || glfwWindowShouldClose(window));
 
     Display::sleep(0.05);
+    tick++;
+  }
+
+  const Replanner& replanner = driver.getReplanner();
+  const ReplanTrigger& trigger = driver.getTrigger();
+  std::cout << "[Simulation]: plans were at most " << replanner.getMaxStaleness()
+            << " ticks old when taken, " << replanner.getDropped() << " dropped as too old, "
+            << replanner.getSpeculationHits() << " of "
+            << replanner.getSpeculations() << " speculative plans taken" << endl;
+  std::cout << "[Simulation]: replan triggers:";
+  for (int e = ReplanTrigger::PATH_END; e < ReplanTrigger::NUM_EVENTS; e++) {
+    ReplanTrigger::Event event = ReplanTrigger::Event(e);
+    std::cout << " " << ReplanTrigger::name(event) << " " << trigger.getCount(event) << ",";
   }
+  std::cout << " skipped " << trigger.getSkips() << " (" << trigger.getDeviations()
+            << " deviations checked)" << endl;
 
   if (simulation.checkVictory()) {
     std::cout << "[Simulation]: The car win." << endl;
@@ -0,0 +1,132 @@
+#include "policy.h"
+
+namespace MDP {
+
+static const char MAGIC[4] = {'L', 'C', 'P', 'T'};
+static const uint32_t VERSION = 1;
+
+//******************************************************************************
+// PolicyTable member functions
+//******************************************************************************
+
+// header: magic, version, number of states, then one decision byte per state
+bool PolicyTable::load(const string& filename) {
+  std::ifstream infile(filename, std::ios::binary);
+  if (!infile) return false;
+
+  char magic[4];
+  uint32_t version, num_states;
+  infile.read(magic, 4);
+  infile.read((char*)&version, sizeof(version));
+  infile.read((char*)&num_states, sizeof(num_states));
+
+  if (!infile || !std::equal(magic, magic + 4, MAGIC) || version != VERSION ||
+      num_states != NUM_STATES) {
+    std::cerr << "[Policy]: " << filename << " is not a valid policy table" << std::endl;
+    return false;
+  }
+
+  vector<unsigned char> table(num_states);
+  infile.read((char*)table.data(), num_states);
+  if (!infile) return false;
+
+  actions = table;
+  return true;
+}
+
+bool PolicyTable::save(const string& filename) const {
+  std::ofstream outfile(filename, std::ios::binary);
+  if (!outfile) return false;
+
+  uint32_t num_states = actions.size();
+  outfile.write(MAGIC, 4);
+  outfile.write((const char*)&VERSION, sizeof(VERSION));
+  outfile.write((const char*)&num_states, sizeof(num_states));
+  outfile.write((const char*)actions.data(), num_states);
+  return bool(outfile);
+}
+
+int PolicyTable::encode(const Situation& s) {
+  int index = s.host_speed;
+  index = index * NUM_GAPS + s.ahead_gap;
+  index = index * NUM_SPEEDS + s.ahead_speed;
+  index = index * NUM_INTENTIONS + s.ahead_intention;
+  index = index * NUM_GAPS + s.behind_gap;
+  index = index * NUM_SPEEDS + s.behind_speed;
+  index = index * NUM_INTENTIONS + s.behind_intention;
+  return index;
+}
+
+Situation PolicyTable::decode(int index) {
+  Situation s;
+  s.behind_intention = index % NUM_INTENTIONS;
+  index /= NUM_INTENTIONS;
+  s.behind_speed = index % NUM_SPEEDS;
+  index /= NUM_SPEEDS;
+  s.behind_gap = index % NUM_GAPS;
+  index /= NUM_GAPS;
+  s.ahead_intention = index % NUM_INTENTIONS;
+  index /= NUM_INTENTIONS;
+  s.ahead_speed = index % NUM_SPEEDS;
+  index /= NUM_SPEEDS;
+  s.ahead_gap = index % NUM_GAPS;
+  index /= NUM_GAPS;
+  s.host_speed = index;
+  return s;
+}
+
+int PolicyTable::speedToBucket(float speed) {
+  int bucket = int(speed);
+  if (bucket < 0) return 0;
+  if (bucket >= NUM_SPEEDS) return NUM_SPEEDS - 1;
+  return bucket;
+}
+
+int PolicyTable::gapToBucket(float gap) {
+  if (gap < 0 || gap >= reach()) return NUM_GAPS - 1;
+  return int(gap / Globals::constant.BELIEF_TILE_SIZE);
+}
+
+Situation PolicyTable::observe(const Simulation& simulation,
+                               const vector<int>& car_intentions) {
+  const Actor* host = simulation.getHost();
+  Vector2f host_pos = host->getPos();
+  Vector2f goal = simulation.getGoal().getCenter();
+
+  // the lane next to the host on the side of the goal
+  float lane = Globals::constant.BELIEF_TILE_SIZE;
+  float target_y = host_pos.y + (goal.y > host_pos.y ? lane : -lane);
+
+  Situation s;
+  s.host_speed = speedToBucket(host->getVelocity().Length());
+  s.ahead_gap = s.behind_gap = NUM_GAPS - 1;
+  s.ahead_speed = s.behind_speed = 0;
+  s.ahead_intention = s.behind_intention = 0;
+
+  float ahead = reach();
+  float behind = reach();
+  vector<Actor*> cars = simulation.getOtherCars();
+
+  for (int i = 0; i < cars.size(); i++) {
+    Vector2f pos = cars[i]->getPos();
+    if (abs(pos.y - target_y) >= lane / 2) continue;
+
+    float gap = pos.x - host_pos.x;
+    int speed = speedToBucket(cars[i]->getVelocity().Length());
+    if (gap >= 0 && gap < ahead) {
+      ahead = gap;
+      s.ahead_gap = gapToBucket(gap);
+      s.ahead_speed = speed;
+      s.ahead_intention = car_intentions[i];
+    } else if (gap < 0 && -gap < behind) {
+      behind = -gap;
+      s.behind_gap = gapToBucket(-gap);
+      s.behind_speed = speed;
+      s.behind_intention = car_intentions[i];
+    }
+  }
+
+  return s;
+}
+
+}  // namespace MDP
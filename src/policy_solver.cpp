@@ -0,0 +1,229 @@
+//
+//  policy_solver.cpp
+//  CarGame
+//
+
+/*
+ * offline value iteration for the lane change policy table, the transitions
+ * of every discretized situation are sampled by stepping Host and Car actors
+ * from a few representative points of the situation
+ *
+ * usage: policy_solver [world] [output]
+ */
+#include "policy.h"
+
+using MDP::PolicyTable;
+using MDP::Situation;
+
+// ticks between two decisions while waiting, and ticks of a lane change
+static const int WAIT_TICKS = 10;
+static const int CHANGE_TICKS = 20;
+
+static const float REWARD_CHANGE = 100;
+static const float REWARD_COLLISION = -1000;
+static const float REWARD_WAIT = -1;
+static const float DISCOUNT = 0.95;
+
+// next state of a transition, -1 for the end of the episode
+struct Outcome {
+  int next;
+  float prob;
+  float reward;
+};
+
+struct Sample {
+  Host host;
+  std::unique_ptr<Car> ahead;
+  std::unique_ptr<Car> behind;
+  int ahead_intention;
+  int behind_intention;
+
+  Sample() : host(Vector2f(0, 0), "east", Vector2f(0, 0)) {}
+};
+
+static std::unique_ptr<Car> makeCar(float x, float speed) {
+  std::unique_ptr<Car> car(new Car(Vector2f(x, 0), "east", Vector2f(0, 0)));
+  car->setVelocity(speed);
+  return car;
+}
+
+static void stepCars(Sample& sample, const Simulation& simulation) {
+  vector<Vector2f> path;
+  if (sample.ahead) {
+    sample.ahead->autonomousAction(path, simulation, sample.ahead_intention);
+    sample.ahead->update();
+  }
+  if (sample.behind) {
+    sample.behind->autonomousAction(path, simulation, sample.behind_intention);
+    sample.behind->update();
+  }
+}
+
+// the nearest car is in front of the host
+static void classify(Situation& s, Car* car, int intention, float host_x,
+                     float& ahead, float& behind) {
+  if (!car) return;
+  float gap = car->getPos().x - host_x;
+  int speed = PolicyTable::speedToBucket(car->getVelocity().Length());
+  if (gap >= 0 && gap < ahead) {
+    ahead = gap;
+    s.ahead_gap = PolicyTable::gapToBucket(gap);
+    s.ahead_speed = speed;
+    s.ahead_intention = intention;
+  } else if (gap < 0 && -gap < behind) {
+    behind = -gap;
+    s.behind_gap = PolicyTable::gapToBucket(-gap);
+    s.behind_speed = speed;
+    s.behind_intention = intention;
+  }
+}
+
+static int situationOf(const Sample& sample) {
+  Situation s;
+  s.host_speed = PolicyTable::speedToBucket(sample.host.getVelocity().Length());
+  s.ahead_gap = s.behind_gap = PolicyTable::NUM_GAPS - 1;
+  s.ahead_speed = s.behind_speed = 0;
+  s.ahead_intention = s.behind_intention = 0;
+
+  float ahead = PolicyTable::reach();
+  float behind = PolicyTable::reach();
+  float host_x = sample.host.getPos().x;
+  classify(s, sample.ahead.get(), sample.ahead_intention, host_x, ahead, behind);
+  classify(s, sample.behind.get(), sample.behind_intention, host_x, ahead, behind);
+  return PolicyTable::encode(s);
+}
+
+// decelerate in the current lane, as DecisionMaker::applyAction "dec"
+static Outcome wait(Sample& sample, const Simulation& simulation) {
+  for (int t = 0; t < WAIT_TICKS; t++) {
+    sample.host.accelerate(sample.host.max_accler * 0.25);
+    sample.host.setWheelAngle(0);
+    sample.host.update();
+    stepCars(sample, simulation);
+  }
+  return Outcome{situationOf(sample), 1, REWARD_WAIT};
+}
+
+// drive forward into the target lane, as Host::autonomousAction, the host
+// is in the target lane for the second half of the change
+static Outcome change(Sample& sample, const Simulation& simulation) {
+  float too_close = Globals::constant.BELIEF_TILE_SIZE * 1.2;
+  for (int t = 0; t < CHANGE_TICKS; t++) {
+    sample.host.accelerate(sample.host.max_wheel_angle);
+    sample.host.update();
+    stepCars(sample, simulation);
+    if (t < CHANGE_TICKS / 2) continue;
+
+    float host_x = sample.host.getPos().x;
+    for (Car* car : {sample.ahead.get(), sample.behind.get()}) {
+      if (car && abs(car->getPos().x - host_x) < too_close)
+        return Outcome{-1, 1, REWARD_COLLISION};
+    }
+  }
+  return Outcome{-1, 1, REWARD_CHANGE};
+}
+
+// representative points inside a bucket
+static vector<float> offsets(bool present) {
+  if (!present) return vector<float>(1, 0.5);
+  return vector<float>{0.25, 0.75};
+}
+
+// sample the transitions of one situation and action, merged by next state
+static vector<Outcome> transitions(const Situation& s, int action,
+                                   const Simulation& simulation) {
+  float tile = Globals::constant.BELIEF_TILE_SIZE;
+  bool has_ahead = s.ahead_gap < PolicyTable::NUM_GAPS - 1;
+  bool has_behind = s.behind_gap < PolicyTable::NUM_GAPS - 1;
+  vector<Outcome> outcomes;
+  int count = 0;
+
+  for (float hs : offsets(true))
+    for (float ag : offsets(has_ahead))
+      for (float as : offsets(has_ahead))
+        for (float bg : offsets(has_behind))
+          for (float bs : offsets(has_behind)) {
+            Sample sample;
+            sample.host.setVelocity(s.host_speed + hs);
+            if (has_ahead) sample.ahead = makeCar((s.ahead_gap + ag) * tile, s.ahead_speed + as);
+            if (has_behind) sample.behind = makeCar(-(s.behind_gap + bg) * tile, s.behind_speed + bs);
+            sample.ahead_intention = s.ahead_intention;
+            sample.behind_intention = s.behind_intention;
+
+            Outcome o = action == MDP::CHANGE ? change(sample, simulation) : wait(sample, simulation);
+            count++;
+
+            bool merged = false;
+            for (auto& other : outcomes) {
+              if (other.next == o.next && other.reward == o.reward) {
+                other.prob += 1;
+                merged = true;
+                break;
+              }
+            }
+            if (!merged) outcomes.push_back(o);
+          }
+
+  for (auto& o : outcomes) o.prob /= count;
+  return outcomes;
+}
+
+static float qValue(const vector<Outcome>& outcomes, const vector<float>& values) {
+  float q = 0;
+  for (const auto& o : outcomes)
+    q += o.prob * (o.reward + (o.next < 0 ? 0 : DISCOUNT * values[o.next]));
+  return q;
+}
+
+int main(int argc, char** argv) {
+  string worldname = argc > 1 ? argv[1] : "road2";
+  string output = argc > 2 ? argv[2] : "../data/policy.bin";
+
+  // the car models take a simulation, the map itself is not used
+  Layout layout(worldname);
+  Simulation simulation(layout);
+
+  const int num_states = PolicyTable::NUM_STATES;
+  vector<vector<Outcome>> model[2];
+  for (int a = 0; a < 2; a++) model[a].resize(num_states);
+
+  for (int i = 0; i < num_states; i++) {
+    Situation s = PolicyTable::decode(i);
+    model[MDP::WAIT][i] = transitions(s, MDP::WAIT, simulation);
+    model[MDP::CHANGE][i] = transitions(s, MDP::CHANGE, simulation);
+  }
+
+  // value iteration
+  vector<float> values(num_states, 0);
+  float delta = inf;
+  int iterations = 0;
+  while (delta > 1e-4 && iterations < 1000) {
+    delta = 0;
+    for (int i = 0; i < num_states; i++) {
+      float v = std::max(qValue(model[MDP::WAIT][i], values),
+                         qValue(model[MDP::CHANGE][i], values));
+      delta = std::max(delta, abs(v - values[i]));
+      values[i] = v;
+    }
+    iterations++;
+  }
+
+  vector<unsigned char> table(num_states);
+  int changes = 0;
+  for (int i = 0; i < num_states; i++) {
+    bool change = qValue(model[MDP::CHANGE][i], values) > qValue(model[MDP::WAIT][i], values);
+    table[i] = change ? MDP::CHANGE : MDP::WAIT;
+    changes += change;
+  }
+
+  PolicyTable policy;
+  policy.assign(table);
+  if (!policy.save(output)) {
+    std::cerr << "[Policy]: can't write " << output << std::endl;
+    return 1;
+  }
+
+  std::cout << "[Policy]: " << iterations << " iterations, " << changes << " of "
+            << num_states << " situations change lane, written to " << output << std::endl;
+  return 0;
+}
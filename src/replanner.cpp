@@ -0,0 +1,270 @@
+#include "replanner.h"
+
+//******************************************************************************
+// Replanner member functions
+//******************************************************************************
+
+Replanner::Replanner(const PlanFunction& function, const PlanFunction& speculative_function, int speculation,
+                     int max_age, int staleness_limit)
+    : plan_function(function),
+      speculative_function(speculative_function),
+      requested(-1),
+      published(-1),
+      running(true),
+      taken(-1),
+      max_staleness(0),
+      staleness_limit(staleness_limit),
+      num_dropped(0),
+      speculation(speculative_function ? speculation : 0),
+      max_age(max_age),
+      generation(0),
+      speculations(0),
+      speculation_hits(0) {
+  worker = std::thread(&Replanner::run, this);
+  if (this->speculation > 0) speculator = std::thread(&Replanner::speculate, this);
+}
+
+Replanner::~Replanner() {
+  running.store(false);
+  worker.join();
+  if (speculator.joinable()) speculator.join();
+}
+
+void Replanner::request(const Simulation& simulation, const vector<int>& car_intentions,
+                        const Counter<vector<string>>& belief, int tick) {
+  Snapshot& snapshot = snapshots.back();
+  snapshot.simulation.reset(new Simulation(simulation));
+  snapshot.car_intentions = car_intentions;
+  snapshot.belief = belief;
+  snapshot.tick = tick;
+  requested.store(tick);
+  snapshots.publish();
+}
+
+bool Replanner::poll(Plan& plan, int tick) {
+  if (!plans.update()) return false;
+
+  // the host has moved too far from the snapshot for the plan to hold, the
+  // trigger asks for another one from where it is now
+  if (staleness_limit > 0 && tick - plans.front().tick > staleness_limit) {
+    num_dropped++;
+    return false;
+  }
+
+  // the front slot is ours until the next update, its buffers are recycled
+  std::swap(plan, plans.front());
+  taken = plan.tick;
+  max_staleness = std::max(max_staleness, tick - taken);
+  return true;
+}
+
+void Replanner::wait(Plan& plan, int tick) {
+  while (pending() || !poll(plan, tick)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+// the worker idles in short sleeps, a snapshot is planned as soon as it is
+// seen
+void Replanner::run() {
+  while (running.load()) {
+    if (!snapshots.update()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    Snapshot& snapshot = snapshots.front();
+    Plan& plan = plans.back();
+    auto begin = std::chrono::steady_clock::now();
+    if (!takeSpeculation(snapshot, plan)) {
+      plan_function(snapshot, plan);
+      plan.tick = snapshot.tick;
+      plan.car_intentions = snapshot.car_intentions;
+    }
+    queueHypotheses(snapshot, plan);
+    plan.plan_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    plans.publish();
+    published.store(snapshot.tick);
+  }
+}
+
+// every hypothesis gets a copy of the snapshot, the worker reuses its own
+void Replanner::queueHypotheses(const Snapshot& snapshot, const Plan& plan) {
+  if (speculation <= 0 || plan.success || !plan.change) return;
+
+  // most likely first, ties in a fixed order
+  vector<std::pair<vector<string>, float>> elems(snapshot.belief.begin(), snapshot.belief.end());
+  std::sort(elems.begin(), elems.end(),
+            [](const std::pair<vector<string>, float>& a, const std::pair<vector<string>, float>& b) {
+              return a.second > b.second || (a.second == b.second && a.first < b.first);
+            });
+
+  vector<Snapshot> queued;
+  for (const auto& item : elems) {
+    if (queued.size() == speculation) break;
+    if (item.first.size() != snapshot.car_intentions.size()) continue;
+
+    vector<int> intentions;
+    for (const string& intention : item.first)
+      intentions.push_back(Inference::g_intention2index.at(intention));
+    if (intentions == snapshot.car_intentions) continue;
+
+    Snapshot hypothesis;
+    hypothesis.simulation.reset(new Simulation(*snapshot.simulation));
+    hypothesis.car_intentions = intentions;
+    hypothesis.belief = snapshot.belief;
+    hypothesis.tick = snapshot.tick;
+    queued.push_back(std::move(hypothesis));
+  }
+
+  std::lock_guard<std::mutex> lock(speculation_mutex);
+  hypotheses.swap(queued);
+}
+
+// plan the hypotheses one at a time, a plan is kept only if no snapshot was
+// taken by the worker in the meantime
+void Replanner::speculate() {
+  while (running.load()) {
+    Snapshot snapshot;
+    unsigned int started = 0;
+    {
+      std::lock_guard<std::mutex> lock(speculation_mutex);
+      if (hypotheses.size() > 0) {
+        snapshot = std::move(hypotheses.front());
+        hypotheses.erase(hypotheses.begin());
+        started = generation;
+      }
+    }
+    if (!snapshot.simulation) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    Plan plan;
+    speculative_function(snapshot, plan);
+    plan.tick = snapshot.tick;
+    plan.car_intentions = snapshot.car_intentions;
+
+    std::lock_guard<std::mutex> lock(speculation_mutex);
+    if (started != generation) continue;
+    speculative.push_back(std::move(plan));
+    speculations++;
+  }
+}
+
+// a speculative plan for the same intentions from a recent enough snapshot. It
+// keeps the tick of the snapshot it was made from. Whether one is taken or not, the
+// speculation on the older snapshot ends here
+bool Replanner::takeSpeculation(const Snapshot& snapshot, Plan& plan) {
+  std::lock_guard<std::mutex> lock(speculation_mutex);
+  generation++;
+  hypotheses.clear();
+
+  bool found = false;
+  for (Plan& candidate : speculative) {
+    if (candidate.car_intentions != snapshot.car_intentions || snapshot.tick - candidate.tick > max_age) continue;
+    plan = std::move(candidate);
+    speculation_hits++;
+    found = true;
+    break;
+  }
+  speculative.clear();
+  return found;
+}
+
+//******************************************************************************
+// ReplanTrigger member functions
+//******************************************************************************
+
+static float distanceToSegment(const Vector2f& p, const Vector2f& a, const Vector2f& b) {
+  Vector2f ab = b - a;
+  Vector2f ap = p - a;
+  float length2 = ab.x * ab.x + ab.y * ab.y;
+  float t = length2 == 0 ? 0 : std::max(0.0f, std::min(1.0f, (ap.x * ab.x + ap.y * ab.y) / length2));
+  Vector2f d = ap - ab * t;
+  return sqrt(d.x * d.x + d.y * d.y);
+}
+
+ReplanTrigger::ReplanTrigger(float tolerance, int interval)
+    : tolerance(tolerance), interval(interval), reset_tick(0), deviations(0) {
+  std::fill(counts, counts + NUM_EVENTS, 0);
+}
+
+void ReplanTrigger::reset(const Simulation& simulation, const vector<int>& car_intentions, int tick) {
+  reset_tick = tick;
+  intentions = car_intentions;
+  predicted.clear();
+  for (const Actor* car : simulation.getOtherCars()) predicted.emplace_back(new Car(*car));
+}
+
+ReplanTrigger::Event ReplanTrigger::check(const Simulation& simulation, const vector<Vector2f>& path,
+                                          const vector<int>& car_intentions, bool waiting, int tick) {
+  // the predictions move like the other cars did since the last tick, a plan
+  // taken this tick is predicted from the cars as they are now
+  vector<Vector2f> no_path;
+  for (int i = 0; i < predicted.size() && tick > reset_tick; i++) {
+    predicted[i]->autonomousAction(no_path, simulation, intentions[i]);
+    predicted[i]->update();
+  }
+
+  Event event = NONE;
+  const Actor* host = simulation.getHost();
+
+  if (waiting) {
+    if (car_intentions != intentions) event = BELIEF;
+    else if (tick - reset_tick >= interval) event = TIMEOUT;
+  } else if (path.size() == 0 || abs(host->getPos().x - path[path.size() - 1].x) < 10) {
+    event = PATH_END;
+  } else if (car_intentions != intentions) {
+    event = BELIEF;
+  } else if (isInfeasible(simulation, path)) {
+    event = INFEASIBLE;
+  } else if (isDeviating(simulation)) {
+    // the path is checked against the cars as they are now
+    deviations++;
+    if (!survives(simulation, path, car_intentions)) event = DEVIATION;
+    else reset(simulation, intentions, reset_tick);
+  }
+
+  counts[event]++;
+  return event;
+}
+
+bool ReplanTrigger::isDeviating(const Simulation& simulation) const {
+  vector<Actor*> cars = simulation.getOtherCars();
+  for (int i = 0; i < cars.size() && i < predicted.size(); i++) {
+    if (cars[i]->getPos().get_distance(predicted[i]->getPos()) > tolerance) return true;
+  }
+  return false;
+}
+
+// roll the rest of the path out from the host
+bool ReplanTrigger::survives(const Simulation& simulation, const vector<Vector2f>& path,
+                             const vector<int>& car_intentions) {
+  Vector2f pos = simulation.getHost()->getPos();
+  vector<Vector2f> rest(1, pos);
+  for (const Vector2f& point : path)
+    if (point.x > pos.x) rest.push_back(point);
+
+  vector<int> cars(car_intentions);
+  return evaluator.evaluatePath(simulation, rest, cars) > -inf;
+}
+
+// the host has passed the end, has left the path, or the rest of the path
+// is off the road
+bool ReplanTrigger::isInfeasible(const Simulation& simulation, const vector<Vector2f>& path) const {
+  Vector2f pos = simulation.getHost()->getPos();
+  if (pos.x > path[path.size() - 1].x) return true;
+
+  float tile = Globals::constant.BELIEF_TILE_SIZE;
+  float nearest = inf;
+  for (int i = 0; i < path.size(); i++) {
+    if (path[i].x < pos.x - tile) continue;
+    if (!simulation.inBounds(path[i].x, path[i].y)) return true;
+    nearest = std::min(nearest, distanceToSegment(pos, path[i > 0 ? i - 1 : 0], path[i]));
+  }
+  return nearest > tile;
+}
+
+const char* ReplanTrigger::name(Event event) {
+  static const char* names[NUM_EVENTS] = {"none", "path end", "deviation", "belief", "infeasible", "timeout"};
+  return names[event];
+}
@@ -2,6 +2,12 @@
 
 namespace SEARCH {
 
+static double elapsedMs(const std::chrono::steady_clock::time_point& begin) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - begin)
+      .count();
+}
+
 //******************************************************************************
 // State member functions
 //******************************************************************************
@@ -30,22 +36,228 @@ ostream& operator<<(ostream& os, const State& s) {
   return os;
 }
 
+//******************************************************************************
+// SearchStats member functions
+//******************************************************************************
+
+SearchStats& SearchStats::operator+=(const SearchStats& s) {
+  nodes_expanded += s.nodes_expanded;
+  successors_generated += s.successors_generated;
+  successors_rejected += s.successors_rejected;
+  successors_blocked += s.successors_blocked;
+  duplicate_pops += s.duplicate_pops;
+  peak_open = std::max(peak_open, s.peak_open);
+  peak_closed = std::max(peak_closed, s.peak_closed);
+  cache_hits += s.cache_hits;
+  elapsed_ms += s.elapsed_ms;
+  return *this;
+}
+
+ostream& operator<<(ostream& os, const SearchStats& s) {
+  os << "{expanded:" << s.nodes_expanded
+     << ", generated:" << s.successors_generated
+     << ", rejected:" << s.successors_rejected
+     << ", blocked:" << s.successors_blocked
+     << ", duplicates:" << s.duplicate_pops << ", peak_open:" << s.peak_open
+     << ", peak_closed:" << s.peak_closed << ", cache_hits:" << s.cache_hits
+     << ", ms:" << s.elapsed_ms << "}";
+  return os;
+}
+
+//******************************************************************************
+// Occupancy member functions
+//******************************************************************************
+
+Occupancy::Occupancy(const Simulation& simulation,
+                     const vector<int>& car_intentions, int horizon)
+    : simulation(simulation), intentions(car_intentions), num_ticks(0) {
+  for (Actor* other : simulation.getOtherCars())
+    cars.push_back(std::unique_ptr<Car>(new Car(*other)));
+  num_cars = cars.size();
+
+  for (const auto& car : cars) {
+    positions.push_back(car->getPos());
+    dirs.push_back(car->getDir());
+  }
+
+  extend(horizon);
+}
+
+void Occupancy::extend(int horizon) {
+  if (horizon <= num_ticks) return;
+  positions.reserve((horizon + 1) * num_cars);
+  dirs.reserve((horizon + 1) * num_cars);
+
+  // the intention model does not depend on the path
+  vector<Vec2f> path;
+  for (; num_ticks < horizon; num_ticks++) {
+    for (int i = 0; i < num_cars; i++) {
+      cars[i]->autonomousAction(path, simulation, intentions[i]);
+      cars[i]->update();
+      positions.push_back(cars[i]->getPos());
+      dirs.push_back(cars[i]->getDir());
+    }
+  }
+}
+
+bool Occupancy::collides(const Vec2f& pos, const vector<Vec2f>& bounds,
+                         int tick) const {
+  if (tick < 0 || tick > num_ticks) return false;
+
+  for (size_t i = tick * num_cars; i < (tick + 1) * num_cars; i++) {
+    Vec2f diff = positions[i] - pos;
+    if (diff.Length() > Actor::RADIUS * 2) continue;
+    Actor car(positions[i], dirs[i], Vec2f(0, 0));
+    if (car.collides(pos, bounds)) return true;
+  }
+
+  return false;
+}
+
+//******************************************************************************
+// PlanCache member functions
+//******************************************************************************
+
+bool PlanCache::lookup(const PlanKey& key, vector<Vec2f>& path) {
+  auto it = index.find(key);
+  if (it == index.end()) {
+    num_misses++;
+    return false;
+  }
+
+  // move the entry to the front as the most recently used
+  entries.splice(entries.begin(), entries, it->second);
+  path = it->second->second;
+  num_hits++;
+  return true;
+}
+
+void PlanCache::insert(const PlanKey& key, const vector<Vec2f>& path) {
+  if (capacity == 0) return;
+
+  auto it = index.find(key);
+  if (it != index.end()) {
+    it->second->second = path;
+    entries.splice(entries.begin(), entries, it->second);
+    return;
+  }
+
+  entries.push_front(Entry(key, path));
+  index[key] = entries.begin();
+
+  if (entries.size() > capacity) {
+    index.erase(entries.back().first);
+    entries.pop_back();
+  }
+}
+
+void PlanCache::reject(const PlanKey& key) {
+  auto it = index.find(key);
+  if (it == index.end()) return;
+  entries.erase(it->second);
+  index.erase(it);
+  // the lookup was counted as a hit, but the path is searched again
+  num_hits--;
+  num_misses++;
+}
+
 //******************************************************************************
 // Search member functions
 //******************************************************************************
 
-Search::Search(Simulation* m, const Vec2f& goal) : simulation(m) {
+Search::Search(Simulation* m, const Vec2f& goal, PlanCache* cache,
+               const Occupancy* occupancy, bool trace)
+    : simulation(m), occupancy(occupancy), tracing(trace) {
+  auto begin = std::chrono::steady_clock::now();
   Vec2f pos = simulation->getHost()->getPos();
   start = State(pvff(pos, Vec2f(1, 0)));
   this->goal = goal;
   cost = 1;
   unitdistanace = 10;
+  ticks_per_step = unitdistanace / simulation->getHost()->max_speed;
 
   for (float ang = 45; ang >= -45; ang -= 15) angle.push_back(ang);
 
+  PlanKey key;
+  if (cache != nullptr) {
+    key = planKey();
+    if (fromCache(cache, key)) {
+      stats.cache_hits = 1;
+      stats.elapsed_ms = elapsedMs(begin);
+      return;
+    }
+  }
+
   State state2 = search();
   list<char> actions = state2.actions;
   pa = path(actions);
+
+  // a failed search, or one the predicted cars cut short, only holds for
+  // this traffic, which the key does not know
+  if (cache != nullptr && pa.size() >= 2 && stats.successors_blocked == 0)
+    cache->insert(key, pa);
+
+  stats.elapsed_ms = elapsedMs(begin);
+}
+
+void Search::dumpTrace(ostream& os) const {
+  for (const auto& cell : trace) os << cell.first << "," << cell.second << "\n";
+}
+
+PlanKey Search::planKey() {
+  Vec2f pos = start.current.first;
+  Vec2f dir = simulation->getHost()->getDir();
+
+  PlanKey key;
+  key.x = pos[0];
+  key.y = pos[1];
+  key.dir_x = dir[0];
+  key.dir_y = dir[1];
+  key.goal_x = goal[0];
+  key.goal_y = goal[1];
+  key.map_version = simulation->getMapVersion();
+  return key;
+}
+
+// the cached path was searched from this very pose, only the traffic may have
+// changed since
+bool Search::fromCache(PlanCache* cache, const PlanKey& key) {
+  vector<Vec2f> result;
+  if (!cache->lookup(key, result)) return false;
+
+  for (int i = 1; i < result.size(); i++) {
+    Vec2f dir = result[i] - result[i - 1];
+    if (isOccupied(result[i], dir, i)) {
+      cache->reject(key);
+      return false;
+    }
+  }
+
+  pa = result;
+  return true;
+}
+
+bool Search::isFeasible(const Vec2f& pos, const Vec2f& dir) {
+  Actor car(pos, normalized(dir), Vec2f(0, 0));
+  // before it was 1.5* car::length now i change to 1 to suit 'road' case
+  vector<Vec2f> bounds =
+      car.getBounds(car, 1.2 * Actor::LENGTH, 1.2 * Actor::WIDTH);
+
+  for (const auto& point : bounds) {
+    if (!simulation->inBoundsLarger(point[0], point[1])) return false;
+  }
+
+  return true;
+}
+
+bool Search::isOccupied(const Vec2f& pos, const Vec2f& dir, int depth) {
+  if (occupancy == nullptr) return false;
+
+  Actor car(pos, normalized(dir), Vec2f(0, 0));
+  vector<Vec2f> bounds = car.getBounds();
+  // the tick of the prediction, when the host arrives at this depth
+  int tick = int(depth * ticks_per_step);
+  return occupancy->collides(pos, bounds, tick);
 }
 
 bool Search::isGoal(State& s) {
@@ -108,27 +320,18 @@ vector<State> Search::getSuccessors(const State& state) {
     Actor car(pos, olddir, velocity);
     car.setWheelAngle(angle[i]);
     car.update();
-    // before it was 1.5* car::length now i change to 1 to suit 'road' case
-    vector<Vec2f> bounds =
-        car.getBounds(car, 1.2 * Actor::LENGTH, 1.2 * Actor::WIDTH);
-    bool inBound = true;
-
-    for (const auto& point : bounds) {
-      if (!simulation->inBoundsLarger(point[0], point[1])) {
-        inBound = false;
-        break;
-      }
-    }
+    bool inBound = isFeasible(car.getPos(), car.getDir());
 
-    // vector<Actor*> cars = simulation->getOtherCars();
-    // for (Actor* othercar : cars) {
-    //  if (othercar->collides(car.getPos(), bounds)){
-    //    inBound = false;
-    //    break;
-    //  }
-    // }
+    if (!inBound) {
+      stats.successors_rejected++;
+      continue;
+    }
 
-    if (!inBound) continue;
+    // other cars at the time the host arrives at the successor
+    if (isOccupied(car.getPos(), car.getDir(), state.actions.size() + 1)) {
+      stats.successors_blocked++;
+      continue;
+    }
 
     Vec2f newPos = car.getPos();
     Vec2f newdir = car.getDir();
@@ -139,6 +342,7 @@ vector<State> Search::getSuccessors(const State& state) {
     // oldcost = oldcost + cost  + 400*abs(angle[i])/180;
     actions.push_back(char(i + 'A'));
     successors.push_back(State({newPos, newdir}, actions, oldcost));
+    stats.successors_generated++;
   }
 
   return successors;
@@ -166,8 +370,14 @@ State Search::search() {
     if (isGoal(state)) return state;
 
     cell = pii(yToRow(position[1]), xToCol(position[0]));
-    if (closed.count(cell) != 0) continue;
+    if (closed.count(cell) != 0) {
+      stats.duplicate_pops++;
+      continue;
+    }
     closed.insert(cell);
+    stats.nodes_expanded++;
+    stats.peak_closed = std::max(stats.peak_closed, closed.size());
+    if (tracing) trace.push_back(cell);
     // get sucesssor
     vector<State> successors = getSuccessors(state);
 
@@ -182,6 +392,7 @@ State Search::search() {
         open.push(ele);
       }
     }
+    stats.peak_open = std::max(stats.peak_open, open.size());
   }
 
   State state2;
@@ -0,0 +1,134 @@
+#include "world.h"
+
+#include <atomic>
+
+//************************************************************************
+// class World: method implementations
+//************************************************************************
+
+// worlds may be made on any thread, each still gets its own version
+static std::atomic<unsigned int> next_version(0);
+
+World::World(Layout& layout) {
+  width = layout.getWidth();
+  height = layout.getHeight();
+  version = ++next_version;
+
+  vector<int> goal_data = layout.getGoal();
+  goal = Block(goal_data);
+  host_start = Vector2f(layout.getStartX(), layout.getStartY());
+  host_dir = layout.getHostDir();
+  other_data = layout.getOtherData();
+
+  for (vector<int> lineData : layout.getLineData())
+    lines.push_back(new Line(lineData));
+
+  for (vector<int> blockData : layout.getBlockData())
+    blocks.push_back(new Block(blockData));
+
+  for (vector<int> data : layout.getHostGraph()) {
+    Block* hostgraph = new Block(data);
+    hostGraph.push_back(hostgraph);
+    allGraph.push_back(hostgraph);
+  }
+
+  for (vector<int> data : layout.getAgentGraph()) {
+    Block* agentgraph = new Block(data);
+    agentGraph.push_back(agentgraph);
+    allGraph.push_back(agentgraph);
+  }
+
+  for (vector<int> blockData : layout.getIntersectionData()) {
+    Block* inter = new Block(blockData);
+    interSections.push_back(inter);
+    allGraph.push_back(inter);
+  }
+
+  initRaster();
+  initIntersectionIndex();
+}
+
+World::~World() {
+  // allGraph only aliases the other graphs
+  clearBlocks(blocks);
+  clearBlocks(interSections);
+  clearBlocks(agentGraph);
+  clearBlocks(hostGraph);
+  allGraph.clear();
+
+  while (lines.size() != 0) {
+    delete lines.back();
+    lines.pop_back();
+  }
+}
+
+void World::clearBlocks(vector<Block*>& bloc) {
+  while (bloc.size() != 0) {
+    delete bloc.back();
+    bloc.pop_back();
+  }
+}
+
+// rasterize the blocks once, a point is tested by its integer pixel like
+// Block::containsPoint does
+void World::initRaster() {
+  raster.assign(width * height, 0);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      unsigned char flags = 0;
+      for (const auto& it : blocks) {
+        if (it->containsPoint(x, y)) flags |= BLOCKED;
+        if (it->containsPointLarger(x, y)) flags |= BLOCKED_LARGER;
+      }
+      raster[y * width + x] = flags;
+    }
+  }
+}
+
+void World::initIntersectionIndex() {
+  int tile = Globals::constant.BLOCK_TILE_SIZE;
+  index_cols = width / tile + 1;
+  index_rows = height / tile + 1;
+  intersection_index.assign(index_cols * index_rows, vector<int>());
+
+  for (int i = 0; i < interSections.size(); i++) {
+    const Block* inter = interSections[i];
+    int col0 = std::max(0, inter->getStartX() / tile);
+    int row0 = std::max(0, inter->getStartY() / tile);
+    int col1 = std::min(index_cols - 1, inter->getEndX() / tile);
+    int row1 = std::min(index_rows - 1, inter->getEndY() / tile);
+    for (int row = row0; row <= row1; row++)
+      for (int col = col0; col <= col1; col++)
+        intersection_index[row * index_cols + col].push_back(i);
+  }
+}
+
+bool World::inBounds(float x, float y) const {
+  if (!(x >= 0 && x < width)) return false;
+  if (!(y >= 0 && y < height)) return false;
+  return (raster[int(y) * width + int(x)] & BLOCKED) == 0;
+}
+
+bool World::inBoundsLarger(float x, float y) const {
+  if (!(x >= 0 && x < width)) return false;
+  if (!(y >= 0 && y < height)) return false;
+  return (raster[int(y) * width + int(x)] & BLOCKED_LARGER) == 0;
+}
+
+const Block* World::getIntersection(float x, float y) const {
+  int tile = Globals::constant.BLOCK_TILE_SIZE;
+  int col = int(x) / tile;
+  int row = int(y) / tile;
+
+  // points off the index are checked against every intersection
+  if (x < 0 || y < 0 || col >= index_cols || row >= index_rows) {
+    for (int i = 0; i < interSections.size(); i++)
+      if (interSections[i]->containsPoint(x, y)) return interSections[i];
+    return nullptr;
+  }
+
+  for (int i : intersection_index[row * index_cols + col])
+    if (interSections[i]->containsPoint(x, y)) return interSections[i];
+  return nullptr;
+}
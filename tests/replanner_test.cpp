@@ -0,0 +1,74 @@
+//
+//  replanner_test.cpp
+//  CarGame
+//
+
+/*
+ * a failed lane change makes the replanner plan the next most likely
+ * intentions ahead, the next request for one of them is answered with that
+ * plan instead of planning again
+ */
+#include "replanner.h"
+
+static int failures = 0;
+
+static void expect(bool condition, const char* what) {
+  if (condition) return;
+  std::cout << "[Test]: failed: " << what << std::endl;
+  failures++;
+}
+
+static void waitFor(const Replanner& replanner, int speculations) {
+  while (replanner.getSpeculations() < speculations) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+int main(void) {
+  Layout layout("road2");
+  Simulation simulation(layout);
+  int num_cars = simulation.getOtherCars().size();
+
+  // every plan is a failed change, tagged with the first intention it was made for
+  auto failed = [](Replanner::Snapshot& snapshot, Replanner::Plan& plan) {
+    plan.success = false;
+    plan.change = true;
+    plan.path.assign(1, Vector2f(float(snapshot.car_intentions[0]), 0));
+  };
+  Replanner replanner(failed, failed, 2, 3);
+
+  // the first car is most likely cooperative, then aggressive
+  vector<int> cooperative(num_cars, Inference::cooperative);
+  vector<int> aggressive(cooperative);
+  aggressive[0] = Inference::aggressive;
+  Counter<vector<string>> belief;
+  vector<string> joint(num_cars, Inference::g_intentions[Inference::cooperative]);
+  belief[joint] = 0.6;
+  joint[0] = Inference::g_intentions[Inference::aggressive];
+  belief[joint] = 0.3;
+  joint[1 % num_cars] = Inference::g_intentions[Inference::aggressive];
+  belief[joint] = 0.1;
+
+  Replanner::Plan plan;
+  replanner.request(simulation, cooperative, belief, 0);
+  replanner.wait(plan, 0);
+  expect(plan.car_intentions == cooperative, "the first plan is made for the requested intentions");
+  waitFor(replanner, 2);
+
+  // the belief has moved to the first hypothesis
+  replanner.request(simulation, aggressive, belief, 2);
+  replanner.wait(plan, 2);
+  expect(replanner.getSpeculationHits() == 1, "the request is answered by a speculative plan");
+  expect(plan.car_intentions == aggressive && plan.path[0].x == Inference::aggressive,
+         "the speculative plan is made for the requested intentions");
+  expect(plan.tick == 0, "the speculative plan keeps the tick of its snapshot");
+  waitFor(replanner, 4);
+
+  // too late for the hypotheses of the last snapshot
+  replanner.request(simulation, cooperative, belief, 6);
+  replanner.wait(plan, 6);
+  expect(replanner.getSpeculationHits() == 1, "a speculative plan older than max_age is not taken");
+  expect(plan.tick == 6, "the request is planned again");
+
+  if (failures > 0) return 1;
+  std::cout << "[Test]: speculation passed" << std::endl;
+  return 0;
+}
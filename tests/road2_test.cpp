@@ -0,0 +1,37 @@
+//
+//  road2_test.cpp
+//  CarGame
+//
+
+/*
+ * replays the default road2 game without the graphics, waiting for every
+ * plan, and fails unless the host reaches the goal
+ */
+#include "driver.h"
+
+int main(void) {
+  Layout layout("road2");
+  Simulation simulation(layout);
+  Actor* host = simulation.getHost();
+  Driver driver(simulation, nullptr, true);
+
+  int tick = 0;
+  for (; tick < 1000; tick++) {
+    if (simulation.checkVictory() || simulation.checkCollision(host)) break;
+    for (Actor* car : simulation.getAllCars()) {
+      if (car == host) {
+        driver.step(simulation, tick);
+      } else {
+        car->autonomousAction(driver.getPath(), simulation, nullptr);
+        car->update();
+      }
+    }
+  }
+
+  std::cout << "[Test]: road2 ended at tick " << tick << ", host at " << host->getPos() << std::endl;
+  if (!simulation.checkVictory()) {
+    std::cout << "[Test]: the host did not reach the goal" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+//
+//  search_test.cpp
+//  CarGame
+//
+
+/*
+ * the paths of the host are searched once from a pose, a second search from
+ * the same pose is answered by the plan cache, and the expanded cells of a
+ * traced search are the ones its statistics count
+ */
+#include "decision_making.h"
+
+static int failures = 0;
+
+static void expect(bool condition, const char* what) {
+  if (condition) return;
+  std::cout << "[Test]: failed: " << what << std::endl;
+  failures++;
+}
+
+int main(void) {
+  Layout layout("road2");
+  Simulation simulation(layout);
+  Actor* host = simulation.getHost();
+  Vec2f goal(host->getPos().x + 50, host->getPos().y);
+
+  // a traced search from the start of the game
+  SEARCH::PlanCache cache;
+  SEARCH::Search first(&simulation, goal, &cache, nullptr, true);
+  vector<Vec2f> path = first.path();
+  const SEARCH::SearchStats& stats = first.getStats();
+  expect(path.size() >= 2, "a path is found from the start");
+  expect(cache.misses() == 1 && cache.hits() == 0, "the first search is not cached");
+  expect(first.getTrace().size() == stats.nodes_expanded, "every expanded cell is traced");
+
+  std::ostringstream dump;
+  first.dumpTrace(dump);
+  int lines = 0;
+  for (char c : dump.str()) lines += c == '\n';
+  expect(lines == int(first.getTrace().size()), "the dump has a line per expanded cell");
+
+  // the same pose and goal again
+  SEARCH::Search second(&simulation, goal, &cache, nullptr, true);
+  expect(cache.hits() == 1 && second.getStats().cache_hits == 1, "the second search is a cache hit");
+  expect(second.getTrace().empty() && second.getStats().nodes_expanded == 0, "a cache hit expands nothing");
+  expect(second.path() == path, "a cache hit gives the searched path");
+
+  SEARCH::SearchStats total;
+  total += stats;
+  total += second.getStats();
+  expect(total.nodes_expanded == stats.nodes_expanded && total.cache_hits == 1, "statistics add up");
+
+  // the candidates of a decision maker, twice from the same pose. The
+  // statistics of each round count the hits the round added to the cache
+  DecisionMaker maker;
+  vector<string> actions{"left", "right"};
+  const SEARCH::PlanCache& plan_cache = maker.getPlanCache();
+  unsigned long num_paths = maker.generatePaths(simulation, actions).size();
+  unsigned long hits = plan_cache.hits();
+  expect(plan_cache.hits() + plan_cache.misses() == num_paths, "every candidate looks up the cache");
+  expect(maker.getSearchStats().cache_hits == hits, "the first round counts its cache hits");
+  maker.generatePaths(simulation, actions);
+  expect(maker.getSearchStats().cache_hits == plan_cache.hits() - hits, "the second round counts its cache hits");
+  expect(plan_cache.hits() - hits > hits, "the second round hits the paths cached by the first");
+
+  if (failures > 0) return 1;
+  std::cout << "[Test]: search passed, " << stats << std::endl;
+  return 0;
+}